@@ -4,13 +4,14 @@
 #pragma once
 #include <variant>
 #include <vector>
-#include <deque>
+#include <array>
 #include <iostream>
 #include <unordered_map>
 #include <mutex>
 #include <optional>
 #include <jw/common.h>
 #include <jw/split_stdint.h>
+#include <jw/chrono/chrono.h>
 #include <jw/thread/thread.h>
 #include <../jwdpmi_config.h>
 
@@ -107,19 +108,13 @@ namespace jw::audio
         }
 
     protected:
-        struct istream_info
-        {
-            std::mutex mutex { };
-            std::deque<byte> pending_msg { };
-            clock::time_point pending_msg_time;
-            byte last_status { 0 };
-        };
+        struct istream_info;
         struct ostream_info
         {
             std::mutex mutex { };
             byte last_status { 0 };
         };
-        inline static std::unordered_map<std::istream*, istream_info> rx_state { };
+        static std::unordered_map<std::istream*, istream_info>& rx_state();
         inline static std::unordered_map<std::ostream*, ostream_info> tx_state { };
 
         struct stream_writer
@@ -160,7 +155,7 @@ namespace jw::audio
             void operator()(const song_position& msg)       { clear_status(); out.put(0xf2); out.put(msg.value.lo); out.put(msg.value.hi); }
             void operator()(const song_select& msg)         { clear_status(); out.put(0xf3); out.put(msg.value); }
 
-            void operator()(const tune_request&)    { out.put(0xf6); }
+            void operator()(const tune_request&)    { clear_status(); out.put(0xf6); }
             void operator()(const clock_tick&)      { out.put(0xf8); }
             void operator()(const clock_start&)     { out.put(0xfa); }
             void operator()(const clock_continue&)  { out.put(0xfb); }
@@ -198,98 +193,168 @@ namespace jw::audio
             return out;
         }
 
-        friend std::istream& operator>>(std::istream& in, midi& out)
+        friend std::istream& operator>>(std::istream& in, midi& out);
+    };
+    namespace detail
+    {
+        // Number of data bytes following each status byte (0x80 - 0xff). Sysex (0xf0) is handled separately.
+        constexpr std::array<byte, 0x80> midi_data_length = []
+        {
+            std::array<byte, 0x80> table { };
+            for (unsigned i = 0x00; i < 0x60; ++i) table[i] = ((i & 0x70) == 0x40 or (i & 0x70) == 0x50) ? 1 : 2;
+            for (unsigned i = 0x60; i < 0x70; ++i) table[i] = 2;
+            table[0x71] = 1;    // mtc quarter frame
+            table[0x72] = 2;    // song position
+            table[0x73] = 1;    // song select
+            return table;
+        }();
+    }
+
+    // Decodes a MIDI byte stream. Bytes can be fed in spans of any size, and messages may be split across
+    // spans. Handles running status, and system realtime bytes interleaved anywhere, even within other
+    // messages. Does not throw, and does not allocate, except to store sysex data.
+    struct midi_parser
+    {
+        using clock = midi::clock;
+
+        // Decode size bytes received at time t. Calls emit(midi&&) for each complete message. Messages are
+        // timestamped with the time their first byte was received.
+        template<typename F>
+        void parse(const byte* data, std::size_t size, clock::time_point t, F&& emit)
         {
-            auto& rx { rx_state[&in] };
-            std::unique_lock<std::mutex> lock { rx.mutex };
-            auto i { rx.pending_msg.cbegin() };
-            auto get = [&]
+            for (auto* const end = data + size; data != end; ++data)
             {
-                if (i != rx.pending_msg.cend()) return *(i++);
-                auto b = static_cast<byte>(in.get());
-                if (b >= 0xf8)  // system realtime messages may be mixed in
+                const byte b = *data;
+                if (__builtin_expect(b >= 0xf8, false))       // system realtime
                 {
-                    out.time = clock::now();
                     switch (b)
                     {
-                    case 0xf8: out.msg = clock_tick { }; break;
-                    case 0xfa: out.msg = clock_start { }; break;
-                    case 0xfb: out.msg = clock_continue { }; break;
-                    case 0xfc: out.msg = clock_stop { }; break;
-                    case 0xfe: out.msg = active_sense { }; break;
-                    case 0xff: out.msg = reset { }; break;
+                    case 0xf8: emit(midi { midi::clock_tick { }, t }); break;
+                    case 0xfa: emit(midi { midi::clock_start { }, t }); break;
+                    case 0xfb: emit(midi { midi::clock_continue { }, t }); break;
+                    case 0xfc: emit(midi { midi::clock_stop { }, t }); break;
+                    case 0xfe: emit(midi { midi::active_sense { }, t }); break;
+                    case 0xff: emit(midi { midi::reset { }, t }); break;
                     }
-                    throw system_realtime_message { };
                 }
-                rx.pending_msg.push_back(b);
-                return b;
-            };
-
-            try
-            {
-                byte a { rx.last_status };
-
-                if (rx.pending_msg.empty())
+                else if (b & 0x80)                          // status byte
                 {
-                    if (a == 0)
+                    if (in_sysex)
                     {
-                        while ((in.peek() & 0x80) == 0) in.get();    // discard data until the first status byte
-                        a = get();
+                        in_sysex = false;
+                        if (b == 0xf7)
+                        {
+                            emit(midi { midi::sysex { { }, sysex_data }, time });
+                            continue;
+                        }
                     }
-                    in.peek();      // make sure there is data available before timestamping
-                    rx.pending_msg_time = clock::now();
-                }
-                else
-                {
-                    if ((rx.pending_msg[0] & 0x80) != 0) a = get();
-                }
-                out.time = rx.pending_msg_time;
-
-                if ((a & 0xf0) != 0xf0)   // channel message
-                {
-                    rx.last_status = a;
-                    byte ch = a & 0x0f;
-                    switch (a & 0xf0)
-                    {
-                    case 0x80: out.msg = note_event { { ch }, false, get(), get() }; break;
-                    case 0x90:
+                    time = t;
+                    count = 0;
+                    running = false;
+                    status = b;
+                    length = detail::midi_data_length[b & 0x7f];
+                    if (b == 0xf0)
                     {
-                        auto key = get();
-                        auto vel = get();
-                        if (vel == 0) out.msg = note_event { { ch }, false, key, vel };
-                        else out.msg = note_event { { ch }, true, key, vel };
-                        break;
+                        in_sysex = true;
+                        sysex_data.clear();
+                        status = 0;
                     }
-                    case 0xa0: out.msg = key_pressure { { ch }, get(), get() }; break;
-                    case 0xb0: out.msg = control_change { { ch }, get(), get() }; break;
-                    case 0xc0: out.msg = program_change { { ch }, get() }; break;
-                    case 0xd0: out.msg = channel_pressure { { ch }, get() }; break;
-                    case 0xe0: out.msg = pitch_change { { ch }, { get(), get() } }; break;
+                    else if (length == 0)
+                    {
+                        if (b == 0xf6) emit(midi { midi::tune_request { }, t });
+                        status = 0;
                     }
                 }
-                else                    // system message
+                else if (in_sysex) sysex_data.push_back(b);
+                else if (status != 0)                       // data byte
                 {
-                    rx.last_status = 0;
-                    switch (a)
+                    if (count == 0 and running) time = t;   // message starts without status byte
+                    buffer[count++] = b;
+                    if (count == length)
                     {
-                    case 0xf0:
-                    {
-                        out.msg = sysex { };
-                        auto& data = std::get<sysex>(out.msg).data;
-                        data.reserve(32);
-                        for (a = get(); a != 0xf7; a = get()) data.push_back(a);
-                        break;
-                    }
-                    case 0xf1: out.msg = mtc_quarter_frame { { }, get() }; break;
-                    case 0xf2: out.msg = song_position { { }, { get(), get() } }; break;
-                    case 0xf3: out.msg = song_select { { }, get() }; break;
-                    case 0xf6: out.msg = tune_request { }; break;
+                        emit(message());
+                        count = 0;
+                        running = true;
+                        if (status >= 0xf0) status = 0;     // system common messages cancel running status
                     }
                 }
-                rx.pending_msg.clear();
             }
-            catch (const system_realtime_message&) { }
-            return in;
         }
+
+        // Decode size bytes, and append the messages to out. Returns the number of messages decoded.
+        std::size_t parse(const byte* data, std::size_t size, clock::time_point t, std::vector<midi>& out)
+        {
+            const auto n = out.size();
+            parse(data, size, t, [&out](midi&& m) { out.emplace_back(std::move(m)); });
+            return out.size() - n;
+        }
+
+        // Discard any partial message and running status.
+        void reset() noexcept
+        {
+            status = 0;
+            count = 0;
+            in_sysex = false;
+            running = false;
+        }
+
+    private:
+        midi message() const noexcept
+        {
+            const byte ch = status & 0x0f;
+            switch (status & 0xf0)
+            {
+            case 0x80: return { midi::note_event { { ch }, false, buffer[0], buffer[1] }, time };
+            case 0x90: return { midi::note_event { { ch }, buffer[1] != 0, buffer[0], buffer[1] }, time };
+            case 0xa0: return { midi::key_pressure { { ch }, buffer[0], buffer[1] }, time };
+            case 0xb0: return { midi::control_change { { ch }, buffer[0], buffer[1] }, time };
+            case 0xc0: return { midi::program_change { { ch }, buffer[0] }, time };
+            case 0xd0: return { midi::channel_pressure { { ch }, buffer[0] }, time };
+            case 0xe0: return { midi::pitch_change { { ch }, { buffer[0], buffer[1] } }, time };
+            }
+            switch (status)
+            {
+            case 0xf1: return { midi::mtc_quarter_frame { { }, buffer[0] }, time };
+            case 0xf2: return { midi::song_position { { }, { buffer[0], buffer[1] } }, time };
+            default:   return { midi::song_select { { }, buffer[0] }, time };
+            }
+        }
+
+        std::vector<byte> sysex_data { };
+        clock::time_point time { };
+        std::array<byte, 2> buffer { };
+        byte status { 0 };
+        byte length { 0 };
+        byte count { 0 };
+        bool in_sysex { false };
+        bool running { false };     // next data byte starts a message under running status
+    };
+
+    struct midi::istream_info
+    {
+        std::mutex mutex { };
+        midi_parser parser { };
     };
+
+    inline std::unordered_map<std::istream*, midi::istream_info>& midi::rx_state()
+    {
+        static std::unordered_map<std::istream*, istream_info> map { };
+        return map;
+    }
+
+    // Reads bytes one at a time, until the parser returns a complete message.
+    inline std::istream& operator>>(std::istream& in, midi& out)
+    {
+        auto& rx { midi::rx_state()[&in] };
+        std::unique_lock<std::mutex> lock { rx.mutex };
+        bool done { false };
+        while (not done)
+        {
+            auto c = in.get();
+            if (c == std::istream::traits_type::eof()) break;
+            const byte b = c;
+            rx.parser.parse(&b, 1, midi::clock::now(), [&](midi&& m) { out = std::move(m); done = true; });
+        }
+        return in;
+    }
 }
@@ -0,0 +1,102 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <vector>
+#include <array>
+#include <ostream>
+#include <jw/audio/midi.h>
+#include <jw/audio/packed_midi.h>
+#include <jw/chrono/chrono.h>
+#include <jw/dpmi/irq.h>
+#include <jw/dpmi/alloc.h>
+#include <jw/dpmi/lock.h>
+
+namespace jw::audio
+{
+    struct midi_scheduler_stats
+    {
+        std::size_t dispatched { 0 };               // messages sent
+        std::size_t dropped { 0 };                  // messages rejected because the queue was full
+        std::size_t busy { 0 };                     // timer ticks where the stream could not take all pending data
+        midi::clock::duration max_jitter { };       // largest delay between scheduled and actual send time
+        midi::clock::duration total_jitter { };     // sum of all delays, divide by dispatched for the mean
+    };
+
+    // Sends time-stamped MIDI messages from the timer interrupt, writing directly into the output stream's
+    // buffer. Messages may be queued in any order, and are kept in a binary heap in locked memory.
+    // The stream buffer must accept writes from interrupt context without waiting, which mpu401_stream does.
+    // rs232_stream does not, since it waits for the UART when its buffer is full, so it is rejected.
+    // The dispatch resolution equals the timer interrupt rate, so program the PIT or RTC through
+    // chrono::setup first. For sub-millisecond dispatch, use eg. setup_pit(true, 0x4a9) (~1kHz) or faster.
+    // Other output on the same stream should be avoided while the scheduler is active, as it may be
+    // interleaved between scheduled messages. Sysex messages can not be scheduled.
+    struct midi_scheduler : dpmi::class_lock<midi_scheduler>
+    {
+        using clock = midi::clock;
+
+        midi_scheduler(std::ostream& stream, chrono::tsc_reference timer = chrono::tsc_reference::pit, std::size_t max_events = 1024);
+        ~midi_scheduler();
+
+        midi_scheduler(const midi_scheduler&) = delete;
+        midi_scheduler(midi_scheduler&&) = delete;
+        midi_scheduler& operator=(const midi_scheduler&) = delete;
+        midi_scheduler& operator=(midi_scheduler&&) = delete;
+
+        // Queue a message to be sent at time t. Returns false if the queue is full.
+        bool schedule(packed_midi msg, clock::time_point t);
+
+        // Queue a message to be sent at msg.time. Messages with time_point::min() are sent on the next tick.
+        // Messages that expand to several packed messages are queued either completely or not at all.
+        bool schedule(const midi& msg);
+
+        // Generate MIDI clock (24 ticks per quarter note). A clock_start message is sent at time t, followed
+        // by the first tick. stop_clock() stops the ticks and sends clock_stop on the next timer interrupt.
+        void start_clock(double bpm, clock::time_point t = clock::now());
+        void set_tempo(double bpm);
+        void stop_clock();
+        bool clock_running() const noexcept { return clock_active; }
+
+        // Discard all pending messages.
+        void clear();
+
+        std::size_t size() const noexcept { return queue.size(); }
+        std::size_t capacity() const noexcept { return max_size; }
+
+        midi_scheduler_stats get_stats() const;
+        void reset_stats();
+
+    private:
+        struct event
+        {
+            clock::time_point time;
+            std::uint32_t sequence;         // keeps events with the same time in order
+            packed_midi msg;
+
+            // Heap order: earliest first.
+            friend bool operator<(const event& a, const event& b) noexcept
+            {
+                return a.time > b.time or (a.time == b.time and static_cast<std::int32_t>(a.sequence - b.sequence) > 0);
+            }
+        };
+
+        void push(packed_midi msg, clock::time_point t);
+        INTERRUPT void dispatch();
+        INTERRUPT void add_jitter(clock::duration d) noexcept;
+
+        std::ostream& out;
+        std::vector<event, dpmi::locking_allocator<event>> queue { };
+        std::size_t max_size;
+        std::uint32_t sequence { 0 };
+        std::array<byte, 64> pending { };   // serialized messages that could not be written yet
+        std::size_t pending_size { 0 };
+
+        bool clock_active { false };
+        clock::time_point next_tick { };
+        clock::duration tick_interval { };
+
+        midi_scheduler_stats stats { };
+
+        dpmi::irq_handler irq { [this]() INTERRUPT { dispatch(); }, dpmi::always_call };
+    };
+}
@@ -0,0 +1,208 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <vector>
+#include <ostream>
+#include <jw/audio/midi.h>
+
+namespace jw::audio
+{
+    // A MIDI message packed in 32 bits: status, two data bytes, and the total message size.
+    // Sysex data is not stored in the message itself. Instead, the complete sysex message (from 0xf0 to 0xf7)
+    // is kept in a separate buffer, and the upper 24 bits hold its offset in that buffer.
+    struct packed_midi
+    {
+        std::uint32_t value;
+
+        constexpr packed_midi() noexcept : value(0) { }
+        constexpr packed_midi(byte status, byte data1 = 0, byte data2 = 0) noexcept
+            : value(status | (data1 << 8) | (data2 << 16) | ((status >= 0xf8 ? 1 : detail::midi_data_length[status & 0x7f] + 1) << 24)) { }
+
+        // Copy a sysex message into sysex_buffer, and return a reference to it.
+        static packed_midi sysex(const byte* data, std::size_t size, std::vector<byte>& sysex_buffer)
+        {
+            packed_midi m { };
+            m.value = 0xf0 | (sysex_buffer.size() << 8);
+            sysex_buffer.push_back(0xf0);
+            sysex_buffer.insert(sysex_buffer.end(), data, data + size);
+            sysex_buffer.push_back(0xf7);
+            return m;
+        }
+
+        constexpr byte status() const noexcept { return value; }
+        constexpr byte data1() const noexcept { return value >> 8; }
+        constexpr byte data2() const noexcept { return value >> 16; }
+        constexpr std::size_t size() const noexcept { return value >> 24; }
+        constexpr bool is_sysex() const noexcept { return status() == 0xf0; }
+        constexpr std::size_t sysex_offset() const noexcept { return value >> 8; }
+
+        // Convert a midi message. Controller messages with 14-bit values, and (N)RPN changes, expand to
+        // multiple packed messages, so these are appended to out.
+        static void pack(const midi& in, std::vector<packed_midi>& out, std::vector<byte>& sysex_buffer)
+        {
+            std::visit(packer { out, sysex_buffer }, in.msg);
+        }
+
+        // Convert back to a midi message. sysex_buffer is only used for sysex messages.
+        midi unpack(const byte* sysex_buffer = nullptr, midi::clock::time_point t = midi::clock::time_point::min()) const
+        {
+            const byte ch = status() & 0x0f;
+            switch (status() & 0xf0)
+            {
+            case 0x80: return { midi::note_event { { ch }, false, data1(), data2() }, t };
+            case 0x90: return { midi::note_event { { ch }, data2() != 0, data1(), data2() }, t };
+            case 0xa0: return { midi::key_pressure { { ch }, data1(), data2() }, t };
+            case 0xb0: return { midi::control_change { { ch }, data1(), data2() }, t };
+            case 0xc0: return { midi::program_change { { ch }, data1() }, t };
+            case 0xd0: return { midi::channel_pressure { { ch }, data1() }, t };
+            case 0xe0: return { midi::pitch_change { { ch }, { data1(), data2() } }, t };
+            }
+            switch (status())
+            {
+            case 0xf0:
+            {
+                midi::sysex msg { };
+                for (auto* p = sysex_buffer + sysex_offset() + 1; *p != 0xf7; ++p) msg.data.push_back(*p);
+                return { std::move(msg), t };
+            }
+            case 0xf1: return { midi::mtc_quarter_frame { { }, data1() }, t };
+            case 0xf2: return { midi::song_position { { }, { data1(), data2() } }, t };
+            case 0xf3: return { midi::song_select { { }, data1() }, t };
+            case 0xf8: return { midi::clock_tick { }, t };
+            case 0xfa: return { midi::clock_start { }, t };
+            case 0xfb: return { midi::clock_continue { }, t };
+            case 0xfc: return { midi::clock_stop { }, t };
+            case 0xfe: return { midi::active_sense { }, t };
+            case 0xff: return { midi::reset { }, t };
+            default:   return { midi::tune_request { }, t };
+            }
+        }
+
+    private:
+        struct packer
+        {
+            std::vector<packed_midi>& out;
+            std::vector<byte>& sysex_buffer;
+
+            void operator()(const midi::note_event& m)         { out.emplace_back((m.on ? 0x90 : 0x80) | (m.channel & 0x0f), m.key, m.velocity); }
+            void operator()(const midi::key_pressure& m)       { out.emplace_back(0xa0 | (m.channel & 0x0f), m.key, m.value); }
+            void operator()(const midi::control_change& m)     { out.emplace_back(0xb0 | (m.channel & 0x0f), m.controller, m.value); }
+            void operator()(const midi::program_change& m)     { out.emplace_back(0xc0 | (m.channel & 0x0f), m.value); }
+            void operator()(const midi::channel_pressure& m)   { out.emplace_back(0xd0 | (m.channel & 0x0f), m.value); }
+            void operator()(const midi::pitch_change& m)       { out.emplace_back(0xe0 | (m.channel & 0x0f), m.value.lo, m.value.hi); }
+
+            void operator()(const midi::sysex& m)              { out.push_back(sysex(m.data.data(), m.data.size(), sysex_buffer)); }
+            void operator()(const midi::mtc_quarter_frame& m)  { out.emplace_back(0xf1, m.data); }
+            void operator()(const midi::song_position& m)      { out.emplace_back(0xf2, m.value.lo, m.value.hi); }
+            void operator()(const midi::song_select& m)        { out.emplace_back(0xf3, m.value); }
+
+            void operator()(const midi::tune_request&)         { out.emplace_back(0xf6); }
+            void operator()(const midi::clock_tick&)           { out.emplace_back(0xf8); }
+            void operator()(const midi::clock_start&)          { out.emplace_back(0xfa); }
+            void operator()(const midi::clock_continue&)       { out.emplace_back(0xfb); }
+            void operator()(const midi::clock_stop&)           { out.emplace_back(0xfc); }
+            void operator()(const midi::active_sense&)         { out.emplace_back(0xfe); }
+            void operator()(const midi::reset&)                { out.emplace_back(0xff); }
+
+            void operator()(const midi::long_control_change& m)
+            {
+                out.emplace_back(0xb0 | (m.channel & 0x0f), m.controller, m.value.hi);
+                out.emplace_back(0xb0 | (m.channel & 0x0f), m.controller + 32, m.value.lo);
+            }
+
+            void operator()(const midi::rpn_change& m)
+            {
+                out.emplace_back(0xb0 | (m.channel & 0x0f), 0x65, m.parameter.hi);
+                out.emplace_back(0xb0 | (m.channel & 0x0f), 0x64, m.parameter.lo);
+                (*this)(midi::long_control_change { { m.channel }, 0x06, m.value });
+            }
+
+            void operator()(const midi::nrpn_change& m)
+            {
+                out.emplace_back(0xb0 | (m.channel & 0x0f), 0x63, m.parameter.hi);
+                out.emplace_back(0xb0 | (m.channel & 0x0f), 0x62, m.parameter.lo);
+                (*this)(midi::long_control_change { { m.channel }, 0x06, m.value });
+            }
+        };
+    };
+    static_assert(sizeof(packed_midi) == 4);
+
+    // Serializes batches of packed messages into one contiguous buffer, using running status, and writes
+    // that to the stream buffer with a single sputn().
+    // Like operator<<, note-off messages are sent as note-on with zero velocity when that saves a status byte.
+    struct midi_writer
+    {
+        midi_writer(std::ostream& o) : out(o) { }
+
+        // Write a batch of messages. sysex_buffer is where any sysex messages in the batch are stored.
+        void write(const packed_midi* begin, const packed_midi* end, const byte* sysex_buffer = nullptr)
+        {
+            buffer.clear();
+            serialize(begin, end, sysex_buffer, buffer);
+            out.rdbuf()->sputn(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        }
+        void write(const std::vector<packed_midi>& msgs, const std::vector<byte>& sysex_buffer = { })
+        {
+            write(msgs.data(), msgs.data() + msgs.size(), sysex_buffer.data());
+        }
+
+        // Serialize messages and append them to dst.
+        void serialize(const packed_midi* begin, const packed_midi* end, const byte* sysex_buffer, std::vector<byte>& dst)
+        {
+            std::size_t max_size { 0 };
+            for (auto* i = begin; i != end; ++i)
+            {
+                if (i->is_sysex())
+                {
+                    auto* p = sysex_buffer + i->sysex_offset();
+                    while (*p++ != 0xf7) ++max_size;
+                    ++max_size;
+                }
+                else max_size += i->size();
+            }
+            const auto start = dst.size();
+            dst.resize(start + max_size);
+            byte* d = dst.data() + start;
+
+            for (auto* i = begin; i != end; ++i)
+            {
+                byte status = i->status();
+                if (i->is_sysex())
+                {
+                    last_status = 0;
+                    auto* p = sysex_buffer + i->sysex_offset();
+                    do { *d++ = *p; } while (*p++ != 0xf7);
+                    continue;
+                }
+                if (status < 0xf0)
+                {
+                    byte data2 = i->data2();
+                    if ((status & 0xf0) == 0x80 and last_status == (status | 0x10))
+                    {
+                        status = last_status;
+                        data2 = 0;
+                    }
+                    if (status != last_status) *d++ = status;
+                    last_status = status;
+                    *d++ = i->data1();
+                    if (i->size() > 2) *d++ = data2;
+                    continue;
+                }
+                if (status < 0xf8) last_status = 0;     // system common messages cancel running status
+                *d++ = status;
+                if (i->size() > 1) *d++ = i->data1();
+                if (i->size() > 2) *d++ = i->data2();
+            }
+            dst.resize(d - dst.data());
+        }
+
+        // Send the next channel message with a status byte, eg. after the stream was interrupted.
+        void clear_status() noexcept { last_status = 0; }
+
+    private:
+        std::ostream& out;
+        std::vector<byte> buffer { };
+        byte last_status { 0 };
+    };
+}
@@ -0,0 +1,185 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <vector>
+#include <array>
+#include <istream>
+#include <ostream>
+#include <optional>
+#include <iterator>
+#include <jw/audio/midi.h>
+#include <jw/audio/packed_midi.h>
+#include <jw/io/io_error.h>
+#include <jw/common.h>
+
+namespace jw::audio
+{
+    struct smf_error : public io::io_error { using io_error::io_error; };
+
+    struct smf_event
+    {
+        midi message;
+        std::uint32_t tick;         // time in ticks since the start of the file
+        std::size_t track;          // index of the track this event came from
+    };
+
+    // Reads type 0 and type 1 Standard MIDI Files. Each track is read in small blocks directly from the
+    // stream, and all tracks are merged on the fly into a single time-ordered sequence, so memory use only
+    // depends on the number of tracks, not on the file size. The stream must be seekable. Since type 1 files
+    // require a seek for every block, larger blocks are faster on files with many tracks.
+    // Channel messages are decoded by midi_parser, which handles running status.
+    // Tick times are converted to midi::clock time through the tempo map, counting from the given start
+    // time. Meta events other than tempo changes are skipped.
+    struct smf_reader
+    {
+        using clock = midi::clock;
+        struct iterator;
+
+        smf_reader(std::istream& file, clock::time_point start = { }, std::size_t block_size = 4_KB);
+
+        smf_reader(const smf_reader&) = delete;
+        smf_reader(smf_reader&&) = delete;
+        smf_reader& operator=(const smf_reader&) = delete;
+        smf_reader& operator=(smf_reader&&) = delete;
+
+        // Read the next event, in order of time. Returns an empty optional at the end of the file.
+        std::optional<smf_event> next();
+
+        iterator begin();
+        iterator end() noexcept;
+
+        std::uint16_t format() const noexcept { return type; }
+        std::size_t tracks() const noexcept { return track_list.size(); }
+        std::uint16_t division() const noexcept { return div; }
+
+    private:
+        struct track
+        {
+            std::streamoff pos;             // file position of the next block
+            std::streamoff end;             // end of the track chunk
+            std::size_t head { 0 }, tail { 0 };
+            std::uint32_t tick { 0 };       // time of the next event
+            byte status { 0 };              // running status
+            bool done { false };
+            midi_parser parser { };
+        };
+
+        byte* block(std::size_t i) noexcept { return blocks.data() + i * block_size; }
+        void fill(std::size_t i);
+        byte get(std::size_t i);
+        std::uint32_t get_vlq(std::size_t i);
+        template<typename F> void get_bytes(std::size_t i, std::size_t n, F&& f);
+        void read_event(std::size_t i);
+        void set_tempo(std::uint32_t tick, std::uint32_t us_per_quarter) noexcept;
+        clock::time_point time_at(std::uint32_t tick) const noexcept;
+
+        std::istream& file;
+        std::streamoff file_pos { -1 };
+        const std::size_t block_size;
+        std::vector<track> track_list { };
+        std::vector<byte> blocks { };
+        std::vector<std::size_t> heap { };
+        std::vector<smf_event> pending { };
+        std::size_t pending_pos { 0 };
+
+        std::uint16_t type;
+        std::uint16_t div;
+        clock::time_point start;
+        std::chrono::nanoseconds base_time { 0 };       // time at base_tick
+        std::uint32_t base_tick { 0 };
+        std::uint64_t tick_num;                         // tick length is tick_num / tick_den nanoseconds
+        std::uint64_t tick_den;
+    };
+
+    struct smf_reader::iterator
+    {
+        using iterator_category = std::input_iterator_tag;
+        using value_type = smf_event;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const smf_event*;
+        using reference = const smf_event&;
+
+        iterator() noexcept = default;
+        iterator(smf_reader* r) : reader(r), event(r->next()) { }
+
+        reference operator*() const noexcept { return *event; }
+        pointer operator->() const noexcept { return &*event; }
+        iterator& operator++() { event = reader->next(); return *this; }
+        iterator operator++(int) { auto i = *this; ++*this; return i; }
+
+        bool operator==(const iterator& other) const noexcept { return not event and not other.event; }
+        bool operator!=(const iterator& other) const noexcept { return not (*this == other); }
+
+    private:
+        smf_reader* reader { nullptr };
+        std::optional<smf_event> event { };
+    };
+
+    inline smf_reader::iterator smf_reader::begin() { return iterator { this }; }
+    inline smf_reader::iterator smf_reader::end() noexcept { return iterator { }; }
+
+    // Writes type 0 or type 1 Standard MIDI Files. Events are written to the stream as they come in, and the
+    // chunk sizes are filled in afterwards, so the stream must be seekable.
+    // A file with one track is written as type 0, otherwise it is type 1. Within a track, events must be
+    // written in order of time.
+    struct smf_writer
+    {
+        using clock = midi::clock;
+
+        // Division is the number of ticks per quarter note.
+        smf_writer(std::ostream& file, std::uint16_t division = 480, clock::time_point start = { });
+        ~smf_writer();
+
+        smf_writer(const smf_writer&) = delete;
+        smf_writer(smf_writer&&) = delete;
+        smf_writer& operator=(const smf_writer&) = delete;
+        smf_writer& operator=(smf_writer&&) = delete;
+
+        // End the current track and start a new one. The first track is started automatically.
+        void new_track();
+
+        // Append a message at msg.time, converted to ticks through the tempo map.
+        void write(const midi& msg) { write(msg, tick_at(msg.time)); }
+
+        // Append a message at the given tick.
+        void write(const midi& msg, std::uint32_t tick);
+
+        // Write a tempo change to the current track, and add it to the tempo map. Tempo changes must be
+        // written in order of time, and for type 1 files they belong in the first track.
+        void set_tempo(std::uint32_t us_per_quarter, clock::time_point t);
+
+        // Convert a time point to ticks since the start of the file.
+        std::uint32_t tick_at(clock::time_point t) const noexcept;
+
+        // End the last track and fill in the header. Called automatically on destruction.
+        void finish();
+
+    private:
+        struct tempo_change
+        {
+            clock::time_point time;
+            std::uint32_t tick;
+            std::uint32_t us_per_quarter;
+        };
+
+        void put_vlq(std::uint32_t value);
+        void put_delta(std::uint32_t tick);
+        void end_track();
+        void flush();
+
+        std::ostream& out;
+        std::streampos header_pos;
+        std::streampos track_pos;
+        std::vector<tempo_change> tempo_map;
+        std::vector<packed_midi> packed { };
+        std::vector<byte> sysex { };
+        std::vector<byte> buffer { };
+        std::uint32_t track_size { 0 };
+        std::uint32_t last_tick { 0 };
+        std::uint16_t track_count { 0 };
+        std::uint16_t div;
+        byte last_status { 0 };
+        bool in_track { false };
+    };
+}
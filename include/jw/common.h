@@ -35,4 +35,9 @@ namespace jw
 #   else
     static constexpr bool sse = false;
 #   endif
+#   ifdef __SSE2__
+    static constexpr bool sse2 = true;
+#   else
+    static constexpr bool sse2 = false;
+#   endif
 }
@@ -0,0 +1,58 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <iostream>
+#include <vector>
+#include <jw/dpmi/irq.h>
+#include <jw/dpmi/alloc.h>
+#include <jw/thread/task.h>
+#include <jw/common.h>
+
+namespace jw
+{
+    namespace debug
+    {
+        // Statistical profiler. Samples the interrupted instruction pointer from the PIT or RTC interrupt,
+        // and optionally walks the frame pointer chain to record a backtrace.
+        // The sample rate is determined by chrono::setup::setup_pit() or setup_rtc().
+        // Samples are collected in a locked ring buffer, and streamed to an ostream (file or rs232) from a
+        // background task. Don't use the same rs232 port as the gdb interface.
+        //
+        // Stream format (little-endian):
+        //  header:  "JWPROF", u8 version, u8 source (0 = pit, 1 = rtc)
+        //  sample:  u8 depth, u32 eip, u32 return_address[depth]
+        //  lost:    u8 0xff, u32 count                 (samples dropped because the buffer was full)
+        // eip is 0 when the sample was taken outside of our code segment.
+        // tools/jwprof.py converts the stream into a flat profile and call graph.
+        struct profiler
+        {
+            enum source : byte { pit, rtc };
+
+            // Start sampling.
+            // max_depth: maximum number of return addresses to record. Requires code compiled with -fno-omit-frame-pointer.
+            // buffer_size: size of the ring buffer, in 32-bit words.
+            static void start(std::ostream& out, source src = pit, std::size_t max_depth = 0, std::size_t buffer_size = 64_KB);
+
+            // Stop sampling, and write all remaining samples to the output stream.
+            static void stop();
+
+            static bool is_running() noexcept { return irq.is_enabled(); }
+
+        private:
+            INTERRUPT static void sample() noexcept;
+            INTERRUPT static bool push(std::size_t& i, std::uint32_t value) noexcept;
+            static void flush();    // only called from flush_task, or from stop() after it has finished
+
+            static dpmi::irq_handler irq;
+            static inline std::vector<std::uint32_t, dpmi::locking_allocator<>> buffer { };
+            static inline volatile std::size_t head { 0 };   // written by interrupt
+            static inline volatile std::size_t tail { 0 };   // written by flush()
+            static inline volatile std::uint32_t lost { 0 };
+            static inline std::size_t depth { 0 };
+            static inline std::uintptr_t stack_limit { 0 };
+            static inline std::ostream* out { nullptr };
+            static thread::task<void()> flush_task;
+        };
+    }
+}
@@ -0,0 +1,85 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <array>
+#include <atomic>
+#include <iostream>
+#include <jw/dpmi/irq_check.h>
+#include <jw/common.h>
+#include <../jwdpmi_config.h>
+
+namespace jw
+{
+    namespace debug
+    {
+        namespace detail
+        {
+            struct trace_event
+            {
+                std::uint64_t tsc;
+                const char* name;
+                std::uint16_t thread;
+                std::uint8_t nesting;
+                char type;                  // 'B' = begin, 'E' = end, 'i' = instant
+            };
+            static_assert(sizeof(trace_event) == 16);
+            static_assert((config::trace_buffer_size & (config::trace_buffer_size - 1)) == 0, "trace_buffer_size must be a power of two.");
+
+            extern std::array<trace_event, config::enable_trace ? config::trace_buffer_size : 1> trace_buffer;
+            inline std::atomic<std::uint32_t> trace_position { 0 };
+            inline volatile bool trace_enabled { false };
+            inline volatile std::uint16_t trace_thread_id { 0 };
+
+            [[gnu::always_inline]] inline void trace(const char* name, char type) noexcept
+            {
+                if constexpr (not config::enable_trace) return;
+                if (__builtin_expect(not trace_enabled, true)) return;
+                auto& e = trace_buffer[trace_position.fetch_add(1, std::memory_order_relaxed) & (trace_buffer.size() - 1)];
+                asm volatile ("rdtsc;" : "=A" (e.tsc));
+                e.name = name;
+                e.thread = trace_thread_id;
+                e.nesting = dpmi::detail::interrupt_count + dpmi::detail::exception_count;
+                e.type = type;
+            }
+        }
+
+        // Record trace events in a locked ring buffer, safe to use from interrupt context.
+        // Names must be string literals, or otherwise outlive the trace buffer.
+        // All trace points compile to nothing unless config::enable_trace is set.
+        inline void trace_begin(const char* name) noexcept { detail::trace(name, 'B'); }
+        inline void trace_end(const char* name) noexcept { detail::trace(name, 'E'); }
+        inline void trace_event(const char* name) noexcept { detail::trace(name, 'i'); }
+
+        // Record a thread switch. Subsequent events are attributed to the new thread.
+        inline void trace_thread_switch(std::uint32_t id) noexcept
+        {
+            if constexpr (not config::enable_trace) return;
+            detail::trace_thread_id = id;
+            detail::trace("thread switch", 'i');
+        }
+
+        // Records a begin and end event for the current scope.
+        struct trace_scope
+        {
+            trace_scope(const char* n) noexcept : name(n) { trace_begin(name); }
+            ~trace_scope() { trace_end(name); }
+
+            trace_scope(const trace_scope&) = delete;
+            trace_scope(trace_scope&&) = delete;
+            trace_scope& operator=(const trace_scope&) = delete;
+            trace_scope& operator=(trace_scope&&) = delete;
+
+        private:
+            const char* name;
+        };
+
+        // Start or stop recording trace events. Starting clears the buffer.
+        void trace_start() noexcept;
+        void trace_stop() noexcept;
+
+        // Write the buffered events in Chrome trace format (chrome://tracing).
+        // Recording is paused while writing. Requires a calibrated TSC, see chrono::setup::setup_tsc().
+        void trace_write_json(std::ostream& out);
+    }
+}
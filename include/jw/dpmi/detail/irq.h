@@ -15,7 +15,7 @@ namespace jw
             class [[gnu::packed]] irq_wrapper : class_lock<irq_wrapper>
             {
             public:
-                using entry_fptr = void(*)(int_vector) noexcept;
+                using entry_fptr = void(*)(int_vector, std::uintptr_t, selector) noexcept;
                 using stack_fptr = byte*(*)() noexcept;
 
             private:
@@ -129,6 +129,8 @@ namespace jw
 
                 static irq_controller& get_irq(irq_level i) { return get(irq_to_vec(i)); }
 
+                static far_ptr32 get_interrupted_frame() noexcept { return interrupted_frame; }
+
                 INTERRUPT static void acknowledge() noexcept
                 {
                     if (is_acknowledged()) return;
@@ -185,11 +187,12 @@ namespace jw
                 }
 
                 INTERRUPT static byte* get_stack_ptr() noexcept;
-                INTERRUPT [[gnu::force_align_arg_pointer]] static void interrupt_entry_point(int_vector vec) noexcept;
+                INTERRUPT [[gnu::force_align_arg_pointer]] static void interrupt_entry_point(int_vector vec, std::uintptr_t frame, selector frame_ss) noexcept;
 
                 static constexpr io::io_port<byte> pic0_cmd { 0x20 };
                 static constexpr io::io_port<byte> pic1_cmd { 0xA0 };
                 static inline irq_controller_data* data { nullptr };
+                static inline far_ptr32 interrupted_frame { };
             };
         }
     }
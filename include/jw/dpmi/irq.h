@@ -94,6 +94,10 @@ namespace jw
             // Call this from your interrupt handler to signal that the IRQ has been successfully handled.
             static void acknowledge() noexcept { detail::irq_controller::acknowledge(); }
 
+            // Returns a pointer to the state saved by the current interrupt, located on the interrupted stack.
+            // Layout: edi, esi, ebp, esp, ebx, edx, ecx, eax, gs, fs, es, ds, eip, cs, eflags (all 32-bit)
+            static far_ptr32 interrupted_frame() noexcept { return detail::irq_controller::get_interrupted_frame(); }
+
         private:
             irq_handler(const irq_handler&) = delete;
             irq_handler(irq_handler&&) = delete;
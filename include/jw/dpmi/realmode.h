@@ -145,30 +145,54 @@ namespace jw
             void free();
         };
 
-        struct realmode_callback : public realmode_callback_base, class_lock<realmode_callback>
+        namespace detail
         {
+            struct realmode_callback_impl : public realmode_callback_base
+            {
+            protected:
+                template<typename F>
+                realmode_callback_impl(F&& function, realmode_registers* slots, byte* stacks, std::size_t stack_size, std::size_t num_slots)
+                    : realmode_callback_base(code.data())
+                    , function_ptr(std::allocator_arg, locking_allocator<> { }, std::forward<F>(function))
+                    , reg_slots(slots), stack_begin(stacks), stack_slot_size(stack_size), max_depth(num_slots), stack_ptr(stack_top(0)) { init_code(); }
+
+            private:
+                static realmode_registers* entry_point(realmode_callback_impl* self, std::uint32_t rm_stack_selector, std::uint32_t rm_stack_offset) noexcept;
+                void init_code() noexcept;
+                byte* stack_top(std::size_t i) const noexcept { return stack_begin + (i + 1) * stack_slot_size - 4; }
+
+                func::function<void(realmode_registers*)> function_ptr;
+                realmode_registers* const reg_slots;
+                byte* const stack_begin;
+                const std::size_t stack_slot_size;
+                const std::size_t max_depth;
+                std::size_t depth { 0 };                                                // index of next free register and stack slot
+
+                [[gnu::packed]] selector fs;                                            // [eax-0x15]
+                [[gnu::packed]] selector gs;                                            // [eax-0x13]
+                [[gnu::packed]] decltype(&entry_point) entry_ptr { &entry_point };      // [eax-0x11]
+                [[gnu::packed]] byte* stack_ptr;                                        // [eax-0x0D] top of the next free stack, or null if all are in use
+                [[gnu::packed]] realmode_callback_impl* self { this };                  // [eax-0x09]
+                std::array<byte, 0x60> code;                                            // [eax-0x05]
+            };
+        }
+
+        // Real-mode callback with preallocated register slots, and one stack of stack_size bytes per slot.
+        // Callbacks may nest up to max_nesting levels deep, further calls return immediately with the carry flag set.
+        template<std::size_t stack_size = 16_KB, std::size_t max_nesting = 4>
+        struct basic_realmode_callback : public detail::realmode_callback_impl, class_lock<basic_realmode_callback<stack_size, max_nesting>>
+        {
+            static_assert(max_nesting > 0);
+
             template<typename F>
-            realmode_callback(F&& function, std::size_t pool_size = 1_KB) 
-                : realmode_callback_base(code.data())
-                , function_ptr(std::allocator_arg, locking_allocator<> { }, std::forward<F>(function))
-                , alloc(pool_size), reg_pool(alloc) { init_code(); }
+            basic_realmode_callback(F&& function)
+                : realmode_callback_impl(std::forward<F>(function), slots.data(), stack.data(), stack_size, max_nesting) { }
 
         private:
-            static void entry_point(realmode_callback* self, std::uint32_t rm_stack_selector, std::uint32_t rm_stack_offset) noexcept;
-            void init_code() noexcept;
-
-            func::function<void(realmode_registers*)> function_ptr;
-            std::array<byte, 16_KB> stack;  // TODO: adjustable size
-            locked_pool_allocator<> alloc;
-            std::vector<realmode_registers, locked_pool_allocator<>> reg_pool;
-
-            [[gnu::packed]] selector fs;                                            // [eax-0x19]
-            [[gnu::packed]] selector gs;                                            // [eax-0x17]
-            [[gnu::packed]] decltype(&entry_point) entry_ptr { &entry_point };      // [eax-0x15]
-            [[gnu::packed]] byte* stack_ptr { stack.data() + stack.size() - 4 };    // [eax-0x11]
-            [[gnu::packed]] realmode_registers* reg_ptr;                            // [eax-0x0D]
-            [[gnu::packed]] realmode_callback* self { this };                       // [eax-0x09]
-            std::array<byte, 0x60> code;                                            // [eax-0x05]
+            std::array<realmode_registers, max_nesting> slots;
+            alignas(0x10) std::array<byte, stack_size * max_nesting> stack;
         };
+
+        using realmode_callback = basic_realmode_callback<>;
     }
 }
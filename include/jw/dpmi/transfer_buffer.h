@@ -0,0 +1,78 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <algorithm>
+#include <jw/dpmi/memory.h>
+#include <jw/dpmi/realmode.h>
+#include <jw/dpmi/irq_check.h>
+#include <../jwdpmi_config.h>
+
+namespace jw
+{
+    namespace dpmi
+    {
+        // Shared conventional memory buffer, for passing data to real-mode code without allocating dos_memory
+        // on every call. Allocated on first use. Not usable from interrupt context.
+        struct transfer_buffer
+        {
+            static dos_memory<byte>& get()
+            {
+                throw_if_irq();
+                if (__builtin_expect(buffer == nullptr, false))
+                    buffer = std::make_unique<dos_memory<byte>>(config::transfer_buffer_size);
+                return *buffer;
+            }
+
+            static far_ptr16 get_dos_ptr() { return get().get_dos_ptr(); }
+            static byte* data() { return get().get_ptr(); }
+            static std::size_t size() noexcept { return config::transfer_buffer_size; }
+
+            // Read 'size' bytes to 'dst' in chunks, through the transfer buffer.
+            // 'read_chunk' is called as std::size_t(far_ptr16 buffer, std::size_t max_size), and returns the
+            // number of bytes it placed in the buffer. Stops early when a chunk is short.
+            // Returns the total number of bytes read.
+            template<typename F>
+            static std::size_t read(void* dst, std::size_t size, F&& read_chunk)
+            {
+                auto& buf = get();
+                auto* out = static_cast<byte*>(dst);
+                std::size_t total { 0 };
+                while (total < size)
+                {
+                    auto n = std::min(size - total, transfer_buffer::size());
+                    auto r = std::min<std::size_t>(read_chunk(buf.get_dos_ptr(), n), n);
+                    std::copy_n(buf.get_ptr(), r, out + total);
+                    total += r;
+                    if (r < n) break;
+                }
+                return total;
+            }
+
+            // Write 'size' bytes from 'src' in chunks, through the transfer buffer.
+            // 'write_chunk' is called as std::size_t(far_ptr16 buffer, std::size_t size), and returns the
+            // number of bytes it consumed from the buffer. Stops early when a chunk is short.
+            // Returns the total number of bytes written.
+            template<typename F>
+            static std::size_t write(const void* src, std::size_t size, F&& write_chunk)
+            {
+                auto& buf = get();
+                auto* in = static_cast<const byte*>(src);
+                std::size_t total { 0 };
+                while (total < size)
+                {
+                    auto n = std::min(size - total, transfer_buffer::size());
+                    std::copy_n(in + total, n, buf.get_ptr());
+                    auto w = std::min<std::size_t>(write_chunk(buf.get_dos_ptr(), n), n);
+                    total += w;
+                    if (w < n) break;
+                }
+                return total;
+            }
+
+        private:
+            static_assert(config::transfer_buffer_size > 0 and config::transfer_buffer_size <= 0xfff0, "Transfer buffer must fit in one real-mode segment.");
+            static inline std::unique_ptr<dos_memory<byte>> buffer;
+        };
+    }
+}
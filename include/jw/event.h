@@ -10,6 +10,11 @@
 #include <algorithm>
 #include <memory>
 #include <list>
+#include <vector>
+#include <new>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
 
 namespace jw
 {
@@ -127,4 +132,237 @@ namespace jw
     private:
         std::list<std::weak_ptr<event_handler>> subscribers;
     };
+
+    // Type-erased callable with fixed inline storage. Never allocates: callables larger than N bytes are
+    // rejected at compile time. Move-only.
+    template<typename sig, std::size_t N = 4 * sizeof(void*)> class small_function;
+    template<typename R, typename... A, std::size_t N>
+    struct small_function<R(A...), N>
+    {
+        small_function() noexcept = default;
+
+        template<typename F, typename = std::enable_if_t<not std::is_same_v<std::decay_t<F>, small_function>>>
+        small_function(F&& f)
+        {
+            using T = std::decay_t<F>;
+            static_assert(sizeof(T) <= N, "Callable too large for small_function.");
+            static_assert(alignof(T) <= alignof(std::max_align_t));
+            static_assert(std::is_nothrow_move_constructible_v<T>);
+            new (storage) T { std::forward<F>(f) };
+            invoke = [](void* p, A... a) -> R { return (*static_cast<T*>(p))(std::forward<A>(a)...); };
+            if constexpr (not std::is_trivially_copyable_v<T>)
+                manage = [](void* dst, void* src) noexcept
+                {
+                    if (dst != nullptr) new (dst) T { std::move(*static_cast<T*>(src)) };
+                    static_cast<T*>(src)->~T();
+                };
+        }
+
+        small_function(small_function&& other) noexcept { *this = std::move(other); }
+        small_function& operator=(small_function&& other) noexcept
+        {
+            if (&other == this) return *this;
+            reset();
+            if (other.manage != nullptr) other.manage(storage, other.storage);
+            else std::memcpy(storage, other.storage, N);
+            invoke = other.invoke;
+            manage = other.manage;
+            other.invoke = nullptr;
+            other.manage = nullptr;
+            return *this;
+        }
+
+        small_function(const small_function&) = delete;
+        small_function& operator=(const small_function&) = delete;
+
+        ~small_function() { reset(); }
+
+        R operator()(A... args) { return invoke(storage, std::forward<A>(args)...); }
+        explicit operator bool() const noexcept { return invoke != nullptr; }
+
+        void reset() noexcept
+        {
+            if (manage != nullptr) manage(nullptr, storage);
+            invoke = nullptr;
+            manage = nullptr;
+        }
+
+    private:
+        alignas(std::max_align_t) std::byte storage[N];
+        R(*invoke)(void*, A...) { nullptr };
+        void(*manage)(void*, void*) noexcept { nullptr };
+    };
+
+    // Identifies a subscription to a lean_event or lean_chain_event. Handles to removed subscriptions are
+    // detected by a generation count, so unsubscribing twice is harmless.
+    struct event_handle
+    {
+        std::uint32_t slot { 0xffffffff };
+        std::uint32_t generation { 0 };
+    };
+
+    namespace detail
+    {
+        // Handlers are stored contiguously, in order of subscription. Subscribing or unsubscribing from
+        // within a handler is allowed: the change is applied when the outermost dispatch returns.
+        template<typename sig> struct lean_event_base;
+        template<typename R, typename... A>
+        struct lean_event_base<R(A...)>
+        {
+            using function_t = small_function<R(A...)>;
+
+            template<typename F>
+            event_handle subscribe(F&& f)
+            {
+                std::uint32_t slot;
+                if (free_slots.empty())
+                {
+                    slot = generations.size();
+                    generations.push_back(0);
+                }
+                else
+                {
+                    slot = free_slots.back();
+                    free_slots.pop_back();
+                }
+                auto& list = (depth > 0) ? added : handlers;
+                list.push_back(entry { function_t { std::forward<F>(f) }, slot });
+                return event_handle { slot, generations[slot] };
+            }
+
+            void unsubscribe(event_handle h)
+            {
+                if (not connected(h)) return;
+                ++generations[h.slot];
+                free_slots.push_back(h.slot);
+                auto match = [h](const entry& e) { return e.slot == h.slot; };
+                auto i = std::find_if(handlers.begin(), handlers.end(), match);
+                if (i == handlers.end())
+                {
+                    added.erase(std::find_if(added.begin(), added.end(), match));
+                    return;
+                }
+                if (depth > 0)
+                {
+                    i->slot = npos;
+                    dirty = true;
+                }
+                else handlers.erase(i);
+            }
+
+            bool connected(event_handle h) const noexcept { return h.slot < generations.size() and generations[h.slot] == h.generation; }
+            std::size_t size() const noexcept { return handlers.size() + added.size(); }
+
+            // Keeps unsubscribed handlers alive until the outermost dispatch is done.
+            struct dispatch_guard
+            {
+                dispatch_guard(lean_event_base* e) noexcept : self(e) { ++self->depth; }
+                ~dispatch_guard() { if (--self->depth == 0) self->cleanup(); }
+                lean_event_base* self;
+            };
+
+        protected:
+            static constexpr std::uint32_t npos { 0xffffffff };
+            struct entry
+            {
+                function_t function;
+                std::uint32_t slot;
+            };
+
+            void cleanup()
+            {
+                if (dirty) handlers.erase(std::remove_if(handlers.begin(), handlers.end(), [](const entry& e) { return e.slot == npos; }), handlers.end());
+                dirty = false;
+                for (auto& e : added) handlers.push_back(std::move(e));
+                added.clear();
+            }
+
+            std::vector<entry> handlers;
+            std::vector<entry> added;
+            std::vector<std::uint32_t> generations;
+            std::vector<std::uint32_t> free_slots;
+            std::uint32_t depth { 0 };
+            bool dirty { false };
+        };
+    }
+
+    // Like event, but without per-call allocations or reference counting. Handlers are small_functions,
+    // stored contiguously, and are called in order of subscription.
+    // Instead of collecting results in a vector, non-void results can be combined with reduce().
+    template<typename sig> class lean_event;
+    template <typename R, typename... A>
+    struct lean_event<R(A...)> : detail::lean_event_base<R(A...)>
+    {
+        template<typename... Args>
+        void operator()(Args&&... args)
+        {
+            typename lean_event::dispatch_guard guard { this };
+            for (std::size_t i = 0, n = this->handlers.size(); i < n; ++i)
+            {
+                auto& e = this->handlers[i];
+                if (e.slot != this->npos) e.function(args...);
+            }
+        }
+
+        // Call all handlers, and combine their results as init = op(init, result).
+        template<typename T, typename Op, typename... Args>
+        T reduce(T init, Op&& op, Args&&... args)
+        {
+            static_assert(not std::is_void_v<R>);
+            typename lean_event::dispatch_guard guard { this };
+            for (std::size_t i = 0, n = this->handlers.size(); i < n; ++i)
+            {
+                auto& e = this->handlers[i];
+                if (e.slot != this->npos) init = op(std::move(init), e.function(args...));
+            }
+            return init;
+        }
+    };
+
+    // Like chain_event, but without per-call allocations or reference counting. The last subscribed
+    // handler is called first, and the chain ends when a handler returns true.
+    template<typename sig> class lean_chain_event;
+    template <typename... A>
+    struct lean_chain_event<bool(A...)> : detail::lean_event_base<bool(A...)>
+    {
+        template<typename... Args>
+        bool operator()(Args&&... args)
+        {
+            typename lean_chain_event::dispatch_guard guard { this };
+            for (std::size_t i = this->handlers.size(); i-- > 0;)
+            {
+                auto& e = this->handlers[i];
+                if (e.slot != this->npos and e.function(args...)) return true;
+            }
+            return false;
+        }
+    };
+
+    // Unsubscribes automatically when destroyed. The event must outlive this object.
+    template<typename E>
+    struct scoped_subscription
+    {
+        scoped_subscription() noexcept = default;
+        template<typename F>
+        scoped_subscription(E& e, F&& f) : event(&e), handle(e.subscribe(std::forward<F>(f))) { }
+        scoped_subscription(scoped_subscription&& o) noexcept : event(o.event), handle(o.handle) { o.event = nullptr; }
+        scoped_subscription& operator=(scoped_subscription&& o) noexcept
+        {
+            reset();
+            std::swap(event, o.event);
+            handle = o.handle;
+            return *this;
+        }
+        ~scoped_subscription() { reset(); }
+
+        void reset()
+        {
+            if (event != nullptr) event->unsubscribe(handle);
+            event = nullptr;
+        }
+
+    private:
+        E* event { nullptr };
+        event_handle handle { };
+    };
 }
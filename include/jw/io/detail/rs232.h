@@ -4,6 +4,7 @@
 #pragma once
 #include <jw/thread/thread.h>
 #include <mutex>
+#include <jw/debug/trace.h>
 
 namespace jw
 {
@@ -205,6 +206,7 @@ namespace jw
 
                 dpmi::irq_handler irq_handler { [this]() INTERRUPT
                 {
+                    debug::trace_scope trace { "rs232" };
                     auto id = irq_id.read();
                     if (not id.no_irq_pending)
                     {
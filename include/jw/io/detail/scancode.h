@@ -3,7 +3,9 @@
 /* Copyright (C) 2016 J.W. Jagersma, see COPYING.txt for details */
 
 #pragma once
-#include <deque>
+#include <array>
+#include <iterator>
+#include <memory>
 
 #include <jw/common.h>
 #include <jw/io/key.h>
@@ -22,37 +24,24 @@ namespace jw
         // Single scancode
             using raw_scancode = byte;
 
-            // Scancode sequence
-            class scancode
+            // Decodes a stream of scancodes one byte at a time, using flat table lookups.
+            // Keeps no sequence buffer, so it can be used directly in the keyboard interrupt handler.
+            struct scancode_decoder
             {
-            public:
-                // Extract full scancode sequences from a sequence of bytes
-                // NOTE: parameter will be modified, extracted sequences are removed
-                static std::deque<scancode> extract(auto& codes, scancode_set set)
-                {
-                    std::deque<scancode> extracted_codes;
-
-                    auto i = codes.begin();
-                    while (i != codes.end())
-                    {
-                        if (set == set2)
-                        {
-                            if (*i == 0xE0) { ++i; continue; }
-                            if (*i == 0xE1) { ++i; continue; }
-                        }
-                        if (*i == 0xF0) { ++i; continue; }
-                        i++;
-                        extracted_codes.push_back({ set, { codes.begin(), i } });
-                        codes.erase(codes.begin(), i);
-                        i = codes.begin();
-                    }
+                // Feed one byte. Returns true if it completes a sequence, which is then decoded into k.
+                bool operator()(raw_scancode c, scancode_set set, key_state_pair& k) noexcept;
 
-                    return extracted_codes;
-                }
+                void reset() noexcept { prefix = 0; release = false; }
 
-                // Decode scancode sequence into key code and state pair
-                key_state_pair decode();
+            private:
+                raw_scancode prefix { 0 };
+                bool release { false };
+            };
 
+            // Scancode translation
+            class scancode
+            {
+            public:
                 // Undo scancode translation for a single byte. No break code handling.
                 static raw_scancode undo_translation(raw_scancode c) noexcept { return undo_translation_table[c]; }
 
@@ -91,20 +80,7 @@ namespace jw
                 };
 
             private:
-                std::deque<raw_scancode> sequence;
-                scancode_set code_set;
-
-                scancode(scancode_set set, std::deque<raw_scancode> seq)
-                    : sequence(seq), code_set(set) { }
-
-                scancode(scancode_set set)
-                    : scancode(set, { }) { }
-
                 static const std::array<raw_scancode, 0x100> undo_translation_table;
-                static std::unordered_map<raw_scancode, raw_scancode> set2_to_set3_table;
-                static std::unordered_map<raw_scancode, const raw_scancode> set2_extended0_to_set3_table;
-                static std::unordered_map<raw_scancode, const raw_scancode> set2_extended0_to_key_table;
-                static std::unordered_map<raw_scancode, key> set3_to_key_table;
             };
         }
     }
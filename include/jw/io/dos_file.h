@@ -0,0 +1,77 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <jw/dpmi/transfer_buffer.h>
+#include <jw/io/io_error.h>
+#include <jw/common.h>
+
+namespace jw
+{
+    namespace io
+    {
+        struct dos_error : public io_error
+        {
+            dos_error(std::uint16_t c, const char* function) : io_error(function), code(c) { }
+            const std::uint16_t code;
+        };
+
+        namespace detail
+        {
+            // Buffered file I/O through INT 21h, bypassing the C library.
+            // Reads and writes in blocks as large as the transfer buffer, to minimize mode switches.
+            struct dos_streambuf : public std::streambuf
+            {
+                dos_streambuf(const char* filename, std::ios::openmode mode, std::size_t buffer_size = 64_KB);
+
+                // Use an already open DOS file handle. Does not close the handle.
+                dos_streambuf(std::uint16_t dos_handle, std::size_t buffer_size = 64_KB);
+
+                virtual ~dos_streambuf();
+
+                dos_streambuf(const dos_streambuf&) = delete;
+                dos_streambuf(dos_streambuf&&) = delete;
+                dos_streambuf& operator=(const dos_streambuf&) = delete;
+                dos_streambuf& operator=(dos_streambuf&&) = delete;
+
+                std::uint16_t get_handle() const noexcept { return handle; }
+
+            protected:
+                virtual int sync() override;
+                virtual std::streamsize xsgetn(char_type* s, std::streamsize n) override;
+                virtual int_type underflow() override;
+                virtual std::streamsize xsputn(const char_type* s, std::streamsize n) override;
+                virtual int_type overflow(int_type c = traits_type::eof()) override;
+                virtual pos_type seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode which = std::ios::in | std::ios::out) override;
+                virtual pos_type seekpos(pos_type pos, std::ios::openmode which = std::ios::in | std::ios::out) override;
+
+            private:
+                std::size_t read(char_type* dst, std::size_t size);
+                std::size_t write(const char_type* src, std::size_t size);
+                std::uint32_t seek(std::int32_t offset, byte origin);
+                void flush_put_area();
+
+                std::vector<char_type> buffer;
+                std::uint16_t handle;
+                bool owns_handle;
+            };
+        }
+
+        struct dos_file_stream : public std::iostream
+        {
+            // note: takes ownership of streambuf pointer.
+            dos_file_stream(detail::dos_streambuf* s) : std::iostream(s), streambuf(s) { }
+
+        private:
+            std::unique_ptr<detail::dos_streambuf> streambuf;
+        };
+
+        inline auto make_dos_file_stream(const char* filename, std::ios::openmode mode = std::ios::in)
+        {
+            return dos_file_stream { new detail::dos_streambuf { filename, mode } };
+        }
+    }
+}
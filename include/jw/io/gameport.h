@@ -9,6 +9,7 @@
 #include <jw/dpmi/lock.h>
 #include <jw/dpmi/alloc.h>
 #include <jw/event.h>
+#include <jw/debug/trace.h>
 #include <jw/vector.h>
 #include <../jwdpmi_config.h>
 #include <limits>
@@ -211,6 +212,7 @@ namespace jw::io
 
         dpmi::irq_handler poll_irq { [this]
         {
+            debug::trace_scope trace { "gameport" };
             poll();
         }, dpmi::always_call };
     };
@@ -0,0 +1,125 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <array>
+#include <istream>
+#include <ostream>
+#include <algorithm>
+#include <jw/io/gameport.h>
+#include <jw/io/gameport_sampler.h>
+#include <jw/io/io_error.h>
+
+namespace jw::io
+{
+    struct gameport_profile_error : public io_error { using io_error::io_error; };
+
+    // Axis calibration, in TSC ticks as measured by gameport_sampler.
+    struct axis_calibration
+    {
+        std::uint32_t min { 0 }, center { 0 }, max { 0 };
+
+        // Start calibrating with the stick at rest.
+        constexpr void set_center(std::uint32_t raw) noexcept { min = center = max = raw; }
+
+        // Extend the range while the stick is moved around.
+        constexpr void extend(std::uint32_t raw) noexcept
+        {
+            min = std::min(min, raw);
+            max = std::max(max, raw);
+        }
+    };
+
+    // Response curve: y = (1 - expo) * x + expo * x^3, applied after the dead zone.
+    struct axis_curve
+    {
+        float deadzone { 0.05f };   // fraction of each half of the range that maps to zero
+        float expo { 0.0f };        // 0 is linear, 1 is cubic
+        bool invert { false };
+    };
+
+    // Maps raw axis timings to fixed-point values through a lookup table. Raw values are quantized to the
+    // table size, and each entry holds the output for the middle of its bucket, with the dead zone and
+    // response curve applied. Output is in Q15 format, from -one to +one.
+    struct axis_map
+    {
+        static constexpr std::size_t size { 512 };
+        static constexpr std::int16_t one { 0x7fff };
+
+        std::uint32_t min { 0 };
+        std::uint32_t shift { 0 };
+        std::array<std::int16_t, size> table { };
+
+        constexpr std::int16_t operator()(std::uint32_t raw) const noexcept
+        {
+            const std::uint32_t i = raw > min ? (raw - min) >> shift : 0;
+            return table[i < size ? i : size - 1];
+        }
+
+        static constexpr axis_map make(const axis_calibration& c, const axis_curve& curve = { }) noexcept
+        {
+            axis_map m { };
+            m.min = c.min;
+            const std::uint32_t span = c.max > c.min ? c.max - c.min : 1;
+            while ((span >> m.shift) >= size) ++m.shift;
+
+            // Shrink the range by half a bucket, so the outer buckets reach full scale.
+            const std::uint32_t half = (1u << m.shift) >> 1;
+            const double lo = c.center > c.min + half ? c.center - c.min - half : 1;
+            const double hi = c.max > c.center + half ? c.max - c.center - half : 1;
+            const double dz = std::clamp(static_cast<double>(curve.deadzone), 0.0, 0.99);
+            const double e = std::clamp(static_cast<double>(curve.expo), 0.0, 1.0);
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                const double raw = c.min + static_cast<double>(i << m.shift) + half;
+                double x = (raw - c.center) / (raw < c.center ? lo : hi);
+                x = std::clamp(x, -1.0, 1.0);
+                double a = x < 0 ? -x : x;
+                a = a < dz ? 0 : (a - dz) / (1 - dz);
+                a = (1 - e) * a + e * a * a * a;
+                if ((x < 0) != curve.invert) a = -a;
+                m.table[i] = static_cast<std::int16_t>(a * one + (a < 0 ? -0.5 : 0.5));
+            }
+            return m;
+        }
+    };
+
+    // Calibration and response curves for all four axes. Saved to a small binary file, so applications
+    // don't need to recalibrate every time. Calibration is stored in nanoseconds, and converted to TSC ticks
+    // on load, so profiles remain valid on a different CPU. The TSC must be calibrated before save or load.
+    struct gameport_profile
+    {
+        std::array<axis_calibration, 4> calibration { };
+        std::array<axis_curve, 4> curve { };
+
+        void set_center(const gameport_sampler::raw_t& raw) noexcept { for (auto i = 0; i < 4; ++i) calibration[i].set_center(raw[i]); }
+        void extend(const gameport_sampler::raw_t& raw) noexcept { for (auto i = 0; i < 4; ++i) calibration[i].extend(raw[i]); }
+
+        void save(std::ostream& file) const;
+        static gameport_profile load(std::istream& file);
+    };
+
+    // Normalizes all four axes through lookup tables. The tables are built once from a profile, or at
+    // compile time when the profile is constexpr.
+    struct gameport_map
+    {
+        using value_t = gameport::value_t<std::int16_t>;
+
+        std::array<axis_map, 4> axes { };
+
+        constexpr gameport_map() noexcept = default;
+        constexpr gameport_map(const gameport_profile& p) noexcept
+        {
+            for (auto i = 0; i < 4; ++i) axes[i] = axis_map::make(p.calibration[i], p.curve[i]);
+        }
+
+        constexpr value_t operator()(const gameport_sampler::raw_t& raw) const noexcept
+        {
+            return { axes[0](raw[0]), axes[1](raw[1]), axes[2](raw[2]), axes[3](raw[3]) };
+        }
+
+        value_t get(const gameport_sampler& s) const { return (*this)(s.raw_counts()); }
+
+        static constexpr float to_float(std::int16_t v) noexcept { return v * (1.0f / axis_map::one); }
+    };
+}
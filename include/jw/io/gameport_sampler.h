@@ -0,0 +1,89 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <array>
+#include <bitset>
+#include <jw/io/gameport.h>
+#include <jw/io/ioport.h>
+#include <jw/chrono/chrono.h>
+#include <jw/dpmi/irq.h>
+#include <jw/dpmi/lock.h>
+
+namespace jw::io
+{
+    struct gameport_sampler_stats
+    {
+        std::size_t samples { 0 };              // completed measurements
+        std::size_t timeouts { 0 };             // measurements where an enabled axis did not settle in time
+        chrono::tsc::duration busy { };         // time spent triggering and reading the port
+        chrono::tsc::duration elapsed { };      // time since the last reset_stats()
+    };
+
+    // Samples the gameport from the timer interrupt. On every n-th interrupt, the one-shot multivibrators
+    // are triggered, and the port is read in a tight loop timed by rdtsc, only until all enabled axes have
+    // settled. The last few samples are kept in a fixed-size circular window with running sums, so both
+    // sampling and smoothing take constant time, and no memory is allocated after construction.
+    // The sample rate equals the timer interrupt rate divided by config::divider, so program the PIT or RTC
+    // through chrono::setup first, eg. setup_pit(true, 0x4a9) for ~1kHz. The TSC must be calibrated.
+    struct gameport_sampler : dpmi::class_lock<gameport_sampler>
+    {
+        using clock = chrono::tsc;
+        using raw_t = gameport::value_t<std::uint32_t>;        // axis timings in TSC ticks
+        static constexpr std::size_t max_window { 64 };
+
+        struct config
+        {
+            port_num port { 0x201 };
+            chrono::tsc_reference timer { chrono::tsc_reference::pit };
+            std::uint32_t divider { 1 };                    // sample on every n-th timer interrupt
+            std::size_t window { 16 };                      // number of samples to average, up to max_window
+            std::bitset<4> enable { 0b1111 };
+            clock::duration timeout { std::chrono::microseconds { 2000 } };    // longest expected axis timing
+        };
+
+        gameport_sampler(config c);
+        ~gameport_sampler();
+
+        gameport_sampler(const gameport_sampler&) = delete;
+        gameport_sampler(gameport_sampler&&) = delete;
+        gameport_sampler& operator=(const gameport_sampler&) = delete;
+        gameport_sampler& operator=(gameport_sampler&&) = delete;
+
+        // Average axis timings over the window, in TSC ticks.
+        raw_t raw_counts() const;
+
+        // Average axis timings over the window, as durations.
+        gameport::raw_t get_raw() const;
+
+        std::bitset<4> buttons() const noexcept { return button_state; }
+
+        // Number of samples currently in the window.
+        std::size_t size() const noexcept { return count; }
+
+        gameport_sampler_stats get_stats() const;
+        void reset_stats();
+
+    private:
+        INTERRUPT void sample();
+
+        const config cfg;
+        io_port<byte> port;
+        std::uint32_t timeout;
+        byte axis_mask;
+
+        std::uint32_t irq_count { 0 };
+        std::array<raw_t, max_window> window { };
+        std::array<std::uint32_t, 4> sum { };
+        std::size_t pos { 0 };
+        std::size_t count { 0 };
+        volatile byte button_state { 0 };
+
+        std::size_t samples { 0 };
+        std::size_t timeouts { 0 };
+        chrono::tsc_count busy { 0 };
+        chrono::tsc_count stats_start;
+
+        dpmi::irq_handler irq { [this]() INTERRUPT { sample(); }, dpmi::always_call | dpmi::no_reentry };
+    };
+}
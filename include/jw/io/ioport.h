@@ -60,6 +60,22 @@ namespace jw
             template <typename T, enable_if_nontrivial_and_sizeof_eq<T, 2> = { } > inline auto in(port_num p) { PORT_IN_NONTRIVIAL(std::uint16_t, ax); }
             template <typename T, enable_if_nontrivial_and_sizeof_eq<T, 4> = { } > inline auto in(port_num p) { PORT_IN_NONTRIVIAL(std::uint32_t, eax); }
 
+            template <typename T> inline void outs(port_num p, const T* data, std::size_t n) noexcept
+            {
+                static_assert(sizeof(T) == 1 or sizeof(T) == 2 or sizeof(T) == 4);
+                if constexpr (sizeof(T) == 1) asm volatile("rep outsb;" : "+S" (data), "+c" (n) : "d" (p) : "memory");
+                if constexpr (sizeof(T) == 2) asm volatile("rep outsw;" : "+S" (data), "+c" (n) : "d" (p) : "memory");
+                if constexpr (sizeof(T) == 4) asm volatile("rep outsd;" : "+S" (data), "+c" (n) : "d" (p) : "memory");
+            }
+
+            template <typename T> inline void ins(port_num p, T* data, std::size_t n) noexcept
+            {
+                static_assert(sizeof(T) == 1 or sizeof(T) == 2 or sizeof(T) == 4);
+                if constexpr (sizeof(T) == 1) asm volatile("rep insb;" : "+D" (data), "+c" (n) : "d" (p) : "memory");
+                if constexpr (sizeof(T) == 2) asm volatile("rep insw;" : "+D" (data), "+c" (n) : "d" (p) : "memory");
+                if constexpr (sizeof(T) == 4) asm volatile("rep insd;" : "+D" (data), "+c" (n) : "d" (p) : "memory");
+            }
+
         #undef PORT_OUT
         #undef PORT_IN
         #undef PORT_OUT_NONTRIVIAL
@@ -70,6 +86,7 @@ namespace jw
         struct out_port
         {
             void write(T value) const { detail::out<T>(p, value); }
+            void write(const T* data, std::size_t n) const { detail::outs<T>(p, data, n); }     // rep outs
             auto& operator=(auto value) const { write(value); return *this; }
             void operator()(T value) const { return write(value); }
 
@@ -84,6 +101,7 @@ namespace jw
         struct in_port
         {
             auto read() const { return detail::in<T>(p); }
+            void read(T* data, std::size_t n) const { detail::ins<T>(p, data, n); }     // rep ins
             operator T() const { return read(); }
             T operator()() const { return read(); }
 
@@ -4,7 +4,7 @@
 /* Copyright (C) 2016 J.W. Jagersma, see COPYING.txt for details */
 
 #pragma once
-#include <unordered_map>
+#include <array>
 #include <memory>
 #include <istream>
 
@@ -21,8 +21,12 @@ namespace jw
         {
             chain_event<bool(key_state_pair)> key_changed;
 
-            const key_state& get(key k) const { return keys[k]; }
-            const key_state& operator[](key k) const { return keys[k]; }
+            // TSC value from the keyboard interrupt that produced the event currently being handled by
+            // key_changed. Compare with chrono::rdtsc() to measure input latency.
+            chrono::tsc_count event_timestamp() const noexcept { return timestamp; }
+
+            const key_state& get(key k) const noexcept { return keys[index(k)]; }
+            const key_state& operator[](key k) const noexcept { return keys[index(k)]; }
 
             void redirect_cin(bool echo = true, std::ostream& echo_stream = std::cout);
             void restore_cin();
@@ -39,7 +43,18 @@ namespace jw
 
         private:
             ps2_interface* ps2 { ps2_interface::instance().get() };
-            mutable std::unordered_map<key, key_state> keys { };
+            // Key states are kept in a flat array: 0000-02FF map directly, E000-E1FF follow after that.
+            // Any other key code shares the bad_key entry.
+            static constexpr std::size_t index(key k) noexcept
+            {
+                if (k < 0x300) return k;
+                if (k >= 0xE000 and k < 0xE200) return k - 0xE000 + 0x300;
+                return key::bad_key;
+            }
+            key_state& state(key k) noexcept { return keys[index(k)]; }
+
+            std::array<key_state, 0x500> keys { };
+            chrono::tsc_count timestamp { 0 };
             std::unique_ptr<std::streambuf> streambuf;
             static inline std::streambuf* cin { nullptr };
             static inline bool cin_redirected { false };
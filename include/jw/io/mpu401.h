@@ -9,6 +9,9 @@
 #include <jw/dpmi/irq.h>
 #include <jw/common.h>
 #include <jw/io/io_error.h>
+#include <jw/debug/trace.h>
+#include <jw/chrono/chrono.h>
+#include <../jwdpmi_config.h>
 
 namespace jw
 {
@@ -19,6 +22,11 @@ namespace jw
             port_num port { 0x330 };
             dpmi::irq_level irq { 9 };
             bool use_irq { false };
+
+            // The MPU does not interrupt when it is ready to send, so in IRQ mode, transmission is driven from
+            // this timer interrupt. Each tick sends as many bytes as the MPU accepts. For full bandwidth on
+            // interfaces without a transmit FIFO, the timer should run at 4kHz or more (see chrono::setup).
+            chrono::tsc_reference tx_timer { chrono::tsc_reference::pit };
         };
 
         namespace detail
@@ -30,8 +38,16 @@ namespace jw
                 bool no_data_available : 1;
             };
 
+            // Both directions use a ring buffer. In IRQ mode, received bytes are stored and timestamped by the
+            // interrupt handler, and transmission happens entirely from interrupts, so the status port is
+            // never polled. Threads waiting for data only check the ring buffer indices.
+            // Without IRQ, the same buffers are filled and drained by polling from the calling thread.
+            // Writes from interrupt context never wait: when the transmit buffer is full, sputn() returns a
+            // short count.
             struct mpu401_streambuf : std::streambuf
             {
+                using clock = config::midi_clock;
+
                 mpu401_streambuf(mpu401_config c);
                 virtual ~mpu401_streambuf();
 
@@ -40,69 +56,77 @@ namespace jw
                 mpu401_streambuf& operator=(const mpu401_streambuf&) = delete;
                 mpu401_streambuf& operator=(mpu401_streambuf&&) = delete;
 
+                // Time at which the next byte in the get area was received. Only valid if in_avail() > 0.
+                clock::time_point timestamp() const noexcept { return rx_time[rx_tail()]; }
+
             protected:
                 virtual int sync() override;
-                virtual std::streamsize xsgetn(char_type* s, std::streamsize n) override;
                 virtual int_type underflow() override;
                 virtual std::streamsize xsputn(const char_type* s, std::streamsize n) override;
                 virtual int_type overflow(int_type c = traits_type::eof()) override;
 
             private:
-                void check_irq_exception()
+                static constexpr std::size_t mask { 1_KB - 1 };
+                std::size_t rx_tail() const noexcept { return (gptr() - rx_buf.begin()) & mask; }
+                std::size_t tx_head() const noexcept { return (pptr() - tx_buf.begin()) & mask; }
+                bool polling() const noexcept
                 {
-                    if (__builtin_expect(irq_exception != nullptr, false))
-                    {
-                        auto e = std::move(irq_exception);
-                        irq_exception = nullptr;
-                        std::rethrow_exception(e);
-                    }
+                    return not cfg.use_irq or not dpmi::interrupt_mask::enabled() or not dpmi::irq_mask::enabled(cfg.irq);
                 }
 
+                // Move received bytes into the ring buffer.
                 void get()
                 {
                     dpmi::interrupt_mask no_irq { };
-                    do
+                    const auto now = clock::now();
+                    while (not status_port.read().no_data_available)
                     {
-                        if (rx_ptr >= rx_buf.end()) throw io::overflow { "MPU401 receive buffer overflow" };
-                        *(rx_ptr++) = data_port.read();
-                    } while (not status_port.read().no_data_available);
-                    setg(rx_buf.begin(), gptr(), rx_ptr);
+                        const byte b = data_port.read();
+                        const auto next = (rx_head + 1) & mask;
+                        if (__builtin_expect(next == rx_tail(), false)) { rx_overflow = true; continue; }
+                        rx_buf[rx_head] = b;
+                        rx_time[rx_head] = now;
+                        rx_head = next;
+                    }
                 }
 
+                // Send buffered bytes until the MPU stops accepting them.
                 void put()
                 {
                     dpmi::interrupt_mask no_irq { };
-                    std::unique_lock<std::recursive_mutex> locked { putting, std::try_to_lock };
-                    if (not locked) return;
-                    while (tx_ptr < pptr() and not status_port.read().dont_send_data)
-                        data_port.write(*tx_ptr++);
+                    const auto head = tx_head();
+                    while (tx_tail != head and not status_port.read().dont_send_data)
+                    {
+                        data_port.write(tx_buf[tx_tail]);
+                        tx_tail = (tx_tail + 1) & mask;
+                    }
                 }
 
                 dpmi::irq_handler irq_handler { [this]() INTERRUPT
                 {
-                    try
+                    debug::trace_scope trace { "mpu401" };
+                    if (not status_port.read().no_data_available)
                     {
-                        if (not status_port.read().no_data_available)
-                        {
-                            dpmi::irq_handler::acknowledge();
-                            get();
-                        }
-                        put();
+                        dpmi::irq_handler::acknowledge();
+                        get();
                     }
-                    catch (...) { irq_exception = std::current_exception(); }
+                    put();
                 } };
 
+                dpmi::irq_handler timer_handler { [this]() INTERRUPT { put(); }, dpmi::always_call };
+
                 mpu401_config cfg;
                 out_port<byte> cmd_port;
                 in_port<mpu401_status> status_port;
                 io_port<byte> data_port;
                 std::recursive_mutex getting, putting;
-                std::exception_ptr irq_exception;
 
-                std::array<char_type, 1_KB> rx_buf;
-                std::array<char_type, 1_KB> tx_buf;
-                char_type* rx_ptr { rx_buf.data() };
-                char_type* tx_ptr { tx_buf.data() };
+                std::array<char_type, mask + 1> rx_buf;
+                std::array<clock::time_point, mask + 1> rx_time;
+                std::array<char_type, mask + 1> tx_buf;
+                volatile std::size_t rx_head { 0 };     // written by get()
+                volatile std::size_t tx_tail { 0 };     // written by put()
+                volatile bool rx_overflow { false };
 
                 static std::unordered_map<port_num, bool> port_use_map;
             };
@@ -112,6 +136,9 @@ namespace jw
         {
             mpu401_stream(mpu401_config c) : std::iostream(&streambuf), streambuf(c) { }
 
+            // Time at which the next byte to be read was received.
+            auto timestamp() const noexcept { return streambuf.timestamp(); }
+
         private:
             detail::mpu401_streambuf streambuf;
         };
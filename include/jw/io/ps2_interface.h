@@ -13,6 +13,7 @@
 #include <jw/io/ioport.h>
 #include <jw/thread/task.h>
 #include <jw/chrono/chrono.h>
+#include <jw/debug/trace.h>
 
 // TODO: clean this up
 // TODO: keyboard commands enum, instead of using raw hex values
@@ -29,9 +30,29 @@ namespace jw
             caps_lock_led = 0b100
         };
 
+        // Key event decoded in the keyboard interrupt handler.
+        struct key_event
+        {
+            key k;
+            key_state state;
+            chrono::tsc_count timestamp;    // TSC value at the start of the interrupt
+        };
+
         struct ps2_interface : dpmi::class_lock<ps2_interface>
         {
-            std::deque<detail::scancode> get_scancodes();
+            // Take the next key event from the queue. Returns false if the queue is empty.
+            bool get_key_event(key_event& e) noexcept
+            {
+                const auto tail = event_tail;
+                if (tail == event_head) return false;
+                e = event_queue[tail];
+                asm volatile ("" ::: "memory");     // finish reading the slot before releasing it
+                event_tail = (tail + 1) & event_mask;
+                return true;
+            }
+
+            // Number of key events lost because the queue was full.
+            std::size_t dropped_key_events() const noexcept { return events_dropped; }
 
             scancode_set current_scancode_set;
             scancode_set get_scancode_set() { return current_scancode_set; }
@@ -246,18 +267,42 @@ namespace jw
 
             thread::task<void()> keyboard_update_thread;
 
-            dpmi::locked_pool_allocator<> alloc { 1_KB };
-            std::deque<detail::raw_scancode, dpmi::locked_pool_allocator<>> scancode_queue { alloc };
+            // Single-producer single-consumer queue. The interrupt handler only writes event_head, and
+            // get_key_event() only writes event_tail.
+            static constexpr std::size_t event_mask { 0x3f };
+            std::array<key_event, event_mask + 1> event_queue;
+            volatile std::size_t event_head { 0 };
+            volatile std::size_t event_tail { 0 };
+            volatile std::size_t events_dropped { 0 };
+            detail::scancode_decoder decoder { };
+            chrono::tsc_count irq_timestamp { 0 };
+
+            // Decode one byte, and queue the event if it completes one. Called from the interrupt handler,
+            // through undo_translation_inserter() when scancode translation is enabled.
+            template<typename> friend struct detail::scancode::undo_translation_iterator;
+            void push_back(detail::raw_scancode c) noexcept
+            {
+                key_state_pair k;
+                if (not decoder(c, current_scancode_set, k)) return;
+                const auto head = event_head;
+                const auto next = (head + 1) & event_mask;
+                if (__builtin_expect(next == event_tail, false)) { ++events_dropped; return; }
+                event_queue[head] = key_event { k.first, k.second, irq_timestamp };
+                asm volatile ("" ::: "memory");     // finish writing the slot before publishing it
+                event_head = next;
+            }
 
             dpmi::irq_handler irq_handler { [this]() INTERRUPT
             {
+                irq_timestamp = chrono::rdtsc();
+                debug::trace_scope trace { "ps2" };
                 if (get_status().data_available)
                 {
                     do
                     {
                         auto c = data_port.read();
-                        if (config.translate_scancodes) *detail::scancode::undo_translation_inserter(scancode_queue) = c;
-                        else scancode_queue.push_back(c);
+                        if (config.translate_scancodes) *detail::scancode::undo_translation_inserter(*this) = c;
+                        else push_back(c);
                     } while (get_status().data_available);
                     if (keyboard_update_thread)
                     {
@@ -265,7 +310,7 @@ namespace jw
                         {
                             thread::invoke_main([this]
                             {
-                                if (scancode_queue.size() == 0) return;
+                                if (event_head == event_tail) return;
                                 keyboard_update_thread->try_await();
                                 keyboard_update_thread->start();
                             });
@@ -3,6 +3,7 @@
 
 #pragma once
 #include <experimental/vector>
+#include <algorithm>
 #include <type_traits>
 #include <jw/vector.h>
 
@@ -11,6 +12,13 @@ namespace jw
     enum class matrix_iterator_direction { up, down, left, right };
     struct invalid_matrix_iterator { };
 
+    struct matrix_segment
+    {
+        vector2i pos;           // position in the underlying matrix
+        std::ptrdiff_t dx;      // +1 or -1, when the range is mirrored
+        std::ptrdiff_t size;
+    };
+
     template<typename R, matrix_iterator_direction D>
     struct matrix_iterator
     {
@@ -166,45 +174,35 @@ namespace jw
 
         constexpr matrix_range& fill(const auto& fill)
         {
-            for (auto&& i : *this) i = fill;
+            for (std::ptrdiff_t y = 0; y < height(); ++y)
+                for_each_segment<true>(y, 0, width(), [&fill](auto, T* p, auto dx, auto n) { std::fill_n(dx > 0 ? p : p - n + 1, n, fill); });
             return *this;
         }
 
         constexpr matrix_range& fill_nowrap(const auto& fill)
         {
             for (std::ptrdiff_t y = 0; y < height(); ++y)
-            {
-                auto left = &remove_const(get({ 0,y })), right = &remove_const(get({ width(), y }));
-                std::fill(std::min(left, right), std::max(left, right), fill);
-            }
+                for_each_segment<false>(y, 0, width(), [&fill](auto, T* p, auto dx, auto n) { std::fill_n(dx > 0 ? p : p - n + 1, n, fill); });
             return *this;
         }
 
-        constexpr matrix_range& assign(const auto& copy)
-        {
-            auto size = vector2i::min(this->size(), copy.size());
-            vector2i p { 0, 0 };
-            for (p.y() = 0; p.y() < size.y(); ++p.y())
-                for (p.x() = 0; p.x() < size.x(); ++p.x())
-                    remove_const(get_maybe_wrap(p)) = copy.get_maybe_wrap(p);
-            return *this;
-        }
+        constexpr matrix_range& assign(const auto& copy) { return assign_impl<true>(copy); }
+        constexpr matrix_range& assign_nowrap(const auto& copy) { return assign_impl<false>(copy); }
 
-        constexpr matrix_range& assign_nowrap(const auto& copy)
+        template<typename F> constexpr matrix_range& apply(F&& f) { return apply_impl<true>([&f](auto, auto& v) { f(v); }); }
+        template<typename F> constexpr matrix_range& apply_nowrap(F&& f) { return apply_impl<false>([&f](auto, auto& v) { f(v); }); }
+        template<typename F> constexpr matrix_range& apply_pos(F&& f) { return apply_impl<true>(std::forward<F>(f)); }
+        template<typename F> constexpr matrix_range& apply_pos_nowrap(F&& f) { return apply_impl<false>(std::forward<F>(f)); }
+
+        // Call f(T* begin, std::size_t n) for each contiguous run of elements, eg. for use with SIMD functions.
+        // Each row produces one run, or more if it wraps. The order of elements within a run may be reversed.
+        template<typename F> constexpr matrix_range& apply_span(F&& f)
         {
-            auto size = vector2i::min(this->size(), copy.size());
-            vector2i p { 0, 0 };
-            for (p.y() = 0; p.y() < size.y(); ++p.y())
-                for (p.x() = 0; p.x() < size.x(); ++p.x())
-                    nowrap(p) = copy.nowrap(p);
+            for (std::ptrdiff_t y = 0; y < height(); ++y)
+                for_each_segment<true>(y, 0, width(), [&f](auto, T* p, auto dx, auto n) { f(dx > 0 ? p : p - n + 1, static_cast<std::size_t>(n)); });
             return *this;
         }
 
-        template<typename F> constexpr matrix_range& apply(F&& f) { for (auto i = begin(); i != end(); ++i) f(*i); return *this; }
-        template<typename F> constexpr matrix_range& apply_nowrap(F&& f) { for(auto i = begin(); i != end(); ++i) f(nowrap(i.position())); return *this; }
-        template<typename F> constexpr matrix_range& apply_pos(F&& f) { for (auto i = begin(); i != end(); ++i) f(i.position(), *i); return *this; }
-        template<typename F> constexpr matrix_range& apply_pos_nowrap(F&& f) { for (auto i = begin(); i != end(); ++i) f(i.position(), nowrap(i.position())); return *this; }
-
         constexpr auto begin() noexcept   { return iterator { *this, { 0, 0 } }; }
         constexpr auto vbegin() noexcept  { return vertical_iterator { *this, { 0, 0 } }; }
         constexpr auto rbegin() noexcept  { return vertical_iterator { *this, size() - vector2i { 1, 1 } }; }
@@ -259,6 +257,66 @@ namespace jw
 
         constexpr T& remove_const(const T& t) const noexcept { return const_cast<T&>(t); }
 
+        // Find how many of the next n elements, starting at p and moving in direction dx, are contiguous in memory.
+        // Wrapping at each level splits the run, mirroring reverses it. This recurses once per level, so the cost
+        // is per row, not per element.
+        template<bool wrap>
+        constexpr matrix_segment segment(vector2i p, std::ptrdiff_t dx, std::ptrdiff_t n, bool wrap_self) const noexcept
+        {
+            if (wrap and wrap_self)
+            {
+                p.wrap({ 0, 0 }, size());
+                n = std::min<std::ptrdiff_t>(n, dx > 0 ? width() - p.x() : p.x() + 1);
+            }
+            if constexpr (L == 0) return { p, dx, n };
+            else return r.template segment<wrap>(pos + p.copysign(dim), dim.x() > 0 ? dx : -dx, n, true);
+        }
+
+        // Call f(x, T* p, dx, n) for each contiguous run in row y, from x0 to x1.
+        template<bool wrap, typename F>
+        constexpr void for_each_segment(std::ptrdiff_t y, std::ptrdiff_t x0, std::ptrdiff_t x1, F&& f) const
+        {
+            for (std::ptrdiff_t x = x0; x < x1;)
+            {
+                auto s = segment<wrap>({ x, y }, 1, x1 - x, false);
+                f(x, &remove_const(matrix().base_get(s.pos)), s.dx, s.size);
+                x += s.size;
+            }
+        }
+
+        template<bool wrap>
+        constexpr matrix_range& assign_impl(const auto& copy)
+        {
+            auto size = vector2i::min(this->size(), copy.size());
+            for (std::ptrdiff_t y = 0; y < size.y(); ++y)
+            {
+                for_each_segment<wrap>(y, 0, size.x(), [&copy, y](auto x, T* dst, auto dx, auto n)
+                {
+                    copy.template for_each_segment<wrap>(y, x, x + n, [x, dst, dx](auto sx, auto* src, auto sdx, auto m)
+                    {
+                        auto* d = dst + (sx - x) * dx;
+                        if (dx > 0 and sdx > 0) std::copy_n(src, m, d);
+                        else if (dx < 0 and sdx < 0) std::copy_n(src - m + 1, m, d - m + 1);
+                        else for (std::ptrdiff_t i = 0; i < m; ++i) d[i * dx] = src[i * sdx];
+                    });
+                });
+            }
+            return *this;
+        }
+
+        template<bool wrap, typename F>
+        constexpr matrix_range& apply_impl(F&& f)
+        {
+            for (std::ptrdiff_t y = 0; y < height(); ++y)
+            {
+                for_each_segment<wrap>(y, 0, width(), [&f, y](auto x, T* p, auto dx, auto n)
+                {
+                    for (std::ptrdiff_t i = 0; i < n; ++i) f(vector2i { x + i, y }, p[i * dx]);
+                });
+            }
+            return *this;
+        }
+
         constexpr const T& get_maybe_wrap(vector2i p) const { return matrix().base_get(abs_pos_maybe_wrap(p)); }
         constexpr const T& get_wrap(vector2i p) const { return matrix().base_get(abs_pos_wrap(p)); }
         constexpr const T& get(vector2i p) const { return matrix().base_get(abs_pos(p)); }
@@ -282,7 +340,7 @@ namespace jw
         constexpr auto range_abs(const vector2i& topleft, const vector2i& bottomright) noexcept { return range(topleft, bottomright - topleft); }
 
         constexpr auto* data() noexcept { return ptr; }
-        constexpr const auto* data() const noexcept { return data(); }
+        constexpr const auto* data() const noexcept { return static_cast<const T*>(ptr); }
         constexpr auto data_size() const noexcept { return this->width() * this->height(); }
 
     protected:
@@ -0,0 +1,295 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <array>
+#include <vector>
+#include <cmath>
+#include <type_traits>
+#include <xmmintrin.h>
+#include <jw/common.h>
+#include <jw/vector.h>
+
+namespace jw
+{
+    // Structure-of-arrays container for vector<N, T>. Each component is stored in its own array, so that the
+    // batch operations below can process four vectors at a time with SSE, without any shuffling.
+    // Conversion from and to vector<N, T> is only available where that type is (N = 2 or 4).
+    template <std::size_t N, typename T>
+    struct soa_vector
+    {
+        soa_vector() = default;
+        soa_vector(std::size_t n) { resize(n); }
+        soa_vector(const vector<N, T>* begin, const vector<N, T>* end) { assign(begin, end); }
+
+        void resize(std::size_t n) { for (auto& c : comp) c.resize(n); }
+        void reserve(std::size_t n) { for (auto& c : comp) c.reserve(n); }
+        void clear() noexcept { for (auto& c : comp) c.clear(); }
+        std::size_t size() const noexcept { return comp[0].size(); }
+
+        void push_back(const vector<N, T>& v) { for (unsigned j = 0; j < N; ++j) comp[j].push_back(v[j]); }
+        void assign(const vector<N, T>* begin, const vector<N, T>* end)
+        {
+            clear();
+            reserve(end - begin);
+            for (auto i = begin; i != end; ++i) push_back(*i);
+        }
+
+        void set(std::size_t i, const vector<N, T>& v) noexcept { for (unsigned j = 0; j < N; ++j) comp[j][i] = v[j]; }
+        vector<N, T> operator[](std::size_t i) const noexcept
+        {
+            vector<N, T> v;
+            for (unsigned j = 0; j < N; ++j) v[j] = comp[j][i];
+            return v;
+        }
+
+        T* component(std::size_t j) noexcept { return comp[j].data(); }
+        const T* component(std::size_t j) const noexcept { return comp[j].data(); }
+
+    private:
+        std::array<std::vector<T>, N> comp;
+    };
+
+    // Row-major matrix for batch transforms. An (N+1)x(N+1) matrix applies an affine transform to
+    // N-dimensional vectors, the last row is ignored.
+    template <std::size_t M, typename T> using batch_matrix = std::array<std::array<T, M>, M>;
+
+    // 16.16 fixed-point conversions, for use with the *_fixed functions below.
+    constexpr std::int32_t fixed_one { 1 << 16 };
+    constexpr std::int32_t to_fixed(float f) noexcept { return static_cast<std::int32_t>(f * fixed_one + (f < 0 ? -0.5f : 0.5f)); }
+    constexpr float from_fixed(std::int32_t x) noexcept { return x / static_cast<float>(fixed_one); }
+    constexpr std::int32_t fixed_mul(std::int32_t a, std::int32_t b) noexcept { return (static_cast<std::int64_t>(a) * b) >> 16; }
+
+    namespace detail
+    {
+        template <std::size_t N, typename T, typename U>
+        inline auto soa_pointers(const soa_vector<N, T>& src, soa_vector<N, U>& dst)
+        {
+            dst.resize(src.size());
+            std::pair<std::array<const T*, N>, std::array<U*, N>> p;
+            for (unsigned j = 0; j < N; ++j)
+            {
+                p.first[j] = src.component(j);
+                p.second[j] = dst.component(j);
+            }
+            return p;
+        }
+
+        constexpr std::uint32_t isqrt(std::uint64_t x) noexcept
+        {
+            std::uint64_t r { 0 }, bit { 1ull << 62 };
+            while (bit > x) bit >>= 2;
+            while (bit != 0)
+            {
+                if (x >= r + bit)
+                {
+                    x -= r + bit;
+                    r = (r >> 1) + bit;
+                }
+                else r >>= 1;
+                bit >>= 2;
+            }
+            return r;
+        }
+    }
+
+    // Transform all vectors in src by matrix m. src and dst may be the same.
+    template <std::size_t N, std::size_t M, typename T>
+    inline void transform(const soa_vector<N, T>& src, soa_vector<N, T>& dst, const batch_matrix<M, T>& m)
+    {
+        static_assert(std::is_floating_point_v<T>, "Use transform_fixed() for integer vectors.");
+        static_assert(M == N or M == N + 1, "Matrix must be NxN, or (N+1)x(N+1) for affine transforms.");
+        auto [in, out] = detail::soa_pointers(src, dst);
+        const auto n = src.size();
+        std::size_t i = 0;
+        if constexpr (sse and std::is_same_v<T, float>)
+        {
+            __m128 mm[N][M];
+            for (unsigned r = 0; r < N; ++r)
+                for (unsigned j = 0; j < M; ++j) mm[r][j] = _mm_set1_ps(m[r][j]);
+            for (; i + 4 <= n; i += 4)
+            {
+                __m128 x[N];
+                for (unsigned j = 0; j < N; ++j) x[j] = _mm_loadu_ps(in[j] + i);
+                for (unsigned r = 0; r < N; ++r)
+                {
+                    __m128 acc = (M > N) ? mm[r][M - 1] : _mm_setzero_ps();
+                    for (unsigned j = 0; j < N; ++j) acc = _mm_add_ps(acc, _mm_mul_ps(mm[r][j], x[j]));
+                    _mm_storeu_ps(out[r] + i, acc);
+                }
+            }
+        }
+        for (; i < n; ++i)
+        {
+            std::array<T, N> x;
+            for (unsigned j = 0; j < N; ++j) x[j] = in[j][i];
+            for (unsigned r = 0; r < N; ++r)
+            {
+                T acc = (M > N) ? m[r][M - 1] : 0;
+                for (unsigned j = 0; j < N; ++j) acc += m[r][j] * x[j];
+                out[r][i] = acc;
+            }
+        }
+    }
+
+    // Normalize all vectors. Zero-length vectors are left unchanged.
+    // With SSE, this uses an approximate reciprocal square root with one Newton-Raphson step (~22 bits).
+    template <std::size_t N, typename T>
+    inline void normalize(soa_vector<N, T>& v)
+    {
+        static_assert(std::is_floating_point_v<T>, "Use normalize_fixed() for integer vectors.");
+        auto [in, out] = detail::soa_pointers(v, v);
+        const auto n = v.size();
+        std::size_t i = 0;
+        if constexpr (sse and std::is_same_v<T, float>)
+        {
+            for (; i + 4 <= n; i += 4)
+            {
+                __m128 x[N];
+                __m128 len2 = _mm_setzero_ps();
+                for (unsigned j = 0; j < N; ++j)
+                {
+                    x[j] = _mm_loadu_ps(in[j] + i);
+                    len2 = _mm_add_ps(len2, _mm_mul_ps(x[j], x[j]));
+                }
+                __m128 r = _mm_rsqrt_ps(len2);
+                r = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), r), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(len2, _mm_mul_ps(r, r))));
+                r = _mm_or_ps(_mm_and_ps(_mm_cmpneq_ps(len2, _mm_setzero_ps()), r), _mm_and_ps(_mm_cmpeq_ps(len2, _mm_setzero_ps()), _mm_set1_ps(1.0f)));
+                for (unsigned j = 0; j < N; ++j) _mm_storeu_ps(out[j] + i, _mm_mul_ps(x[j], r));
+            }
+        }
+        for (; i < n; ++i)
+        {
+            T len2 { 0 };
+            for (unsigned j = 0; j < N; ++j) len2 += in[j][i] * in[j][i];
+            if (len2 == 0) continue;
+            const T r = 1 / std::sqrt(len2);
+            for (unsigned j = 0; j < N; ++j) out[j][i] *= r;
+        }
+    }
+
+    // Calculate the dot product of each pair of vectors in a and b. result must hold a.size() elements.
+    template <std::size_t N, typename T>
+    inline void dot(const soa_vector<N, T>& a, const soa_vector<N, T>& b, T* result)
+    {
+        static_assert(std::is_floating_point_v<T>, "Use dot_fixed() for integer vectors.");
+        const auto n = a.size();
+        std::size_t i = 0;
+        if constexpr (sse and std::is_same_v<T, float>)
+        {
+            for (; i + 4 <= n; i += 4)
+            {
+                __m128 acc = _mm_setzero_ps();
+                for (unsigned j = 0; j < N; ++j) acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a.component(j) + i), _mm_loadu_ps(b.component(j) + i)));
+                _mm_storeu_ps(result + i, acc);
+            }
+        }
+        for (; i < n; ++i)
+        {
+            T acc { 0 };
+            for (unsigned j = 0; j < N; ++j) acc += a.component(j)[i] * b.component(j)[i];
+            result[i] = acc;
+        }
+    }
+
+    // Linear interpolation from a to b by t, for each pair of vectors. dst may be the same as a or b.
+    template <std::size_t N, typename T>
+    inline void lerp(const soa_vector<N, T>& a, const soa_vector<N, T>& b, T t, soa_vector<N, T>& dst)
+    {
+        static_assert(std::is_floating_point_v<T>, "Use lerp_fixed() for integer vectors.");
+        auto [in, out] = detail::soa_pointers(a, dst);
+        const auto n = a.size();
+        for (unsigned j = 0; j < N; ++j)
+        {
+            const T* x = in[j];
+            const T* y = b.component(j);
+            std::size_t i = 0;
+            if constexpr (sse and std::is_same_v<T, float>)
+            {
+                const __m128 tt = _mm_set1_ps(t);
+                for (; i + 4 <= n; i += 4)
+                {
+                    const __m128 xx = _mm_loadu_ps(x + i);
+                    _mm_storeu_ps(out[j] + i, _mm_add_ps(xx, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(y + i), xx), tt)));
+                }
+            }
+            for (; i < n; ++i) out[j][i] = x[i] + (y[i] - x[i]) * t;
+        }
+    }
+
+    // Convert between floating-point and 16.16 fixed-point vectors.
+    template <std::size_t N>
+    inline void to_fixed(const soa_vector<N, float>& src, soa_vector<N, std::int32_t>& dst)
+    {
+        auto [in, out] = detail::soa_pointers(src, dst);
+        for (unsigned j = 0; j < N; ++j)
+            for (std::size_t i = 0; i < src.size(); ++i) out[j][i] = to_fixed(in[j][i]);
+    }
+
+    template <std::size_t N>
+    inline void from_fixed(const soa_vector<N, std::int32_t>& src, soa_vector<N, float>& dst)
+    {
+        auto [in, out] = detail::soa_pointers(src, dst);
+        for (unsigned j = 0; j < N; ++j)
+            for (std::size_t i = 0; i < src.size(); ++i) out[j][i] = from_fixed(in[j][i]);
+    }
+
+    // 16.16 fixed-point variants of the above, for machines without a (fast) FPU.
+    // Products are accumulated in 64 bits, and rounded down once.
+
+    template <std::size_t N, std::size_t M>
+    inline void transform_fixed(const soa_vector<N, std::int32_t>& src, soa_vector<N, std::int32_t>& dst, const batch_matrix<M, std::int32_t>& m)
+    {
+        static_assert(M == N or M == N + 1, "Matrix must be NxN, or (N+1)x(N+1) for affine transforms.");
+        auto [in, out] = detail::soa_pointers(src, dst);
+        for (std::size_t i = 0; i < src.size(); ++i)
+        {
+            std::array<std::int32_t, N> x;
+            for (unsigned j = 0; j < N; ++j) x[j] = in[j][i];
+            for (unsigned r = 0; r < N; ++r)
+            {
+                std::int64_t acc = (M > N) ? static_cast<std::int64_t>(m[r][M - 1]) << 16 : 0;
+                for (unsigned j = 0; j < N; ++j) acc += static_cast<std::int64_t>(m[r][j]) * x[j];
+                out[r][i] = acc >> 16;
+            }
+        }
+    }
+
+    template <std::size_t N>
+    inline void normalize_fixed(soa_vector<N, std::int32_t>& v)
+    {
+        auto [in, out] = detail::soa_pointers(v, v);
+        for (std::size_t i = 0; i < v.size(); ++i)
+        {
+            std::uint64_t len2 { 0 };
+            for (unsigned j = 0; j < N; ++j) len2 += static_cast<std::int64_t>(in[j][i]) * in[j][i];
+            const std::uint32_t len = detail::isqrt(len2);
+            if (len == 0) continue;
+            const std::int64_t r = (1ull << 32) / len;    // 16.16 reciprocal
+            for (unsigned j = 0; j < N; ++j) out[j][i] = (in[j][i] * r) >> 16;
+        }
+    }
+
+    template <std::size_t N>
+    inline void dot_fixed(const soa_vector<N, std::int32_t>& a, const soa_vector<N, std::int32_t>& b, std::int32_t* result)
+    {
+        for (std::size_t i = 0; i < a.size(); ++i)
+        {
+            std::int64_t acc { 0 };
+            for (unsigned j = 0; j < N; ++j) acc += static_cast<std::int64_t>(a.component(j)[i]) * b.component(j)[i];
+            result[i] = acc >> 16;
+        }
+    }
+
+    template <std::size_t N>
+    inline void lerp_fixed(const soa_vector<N, std::int32_t>& a, const soa_vector<N, std::int32_t>& b, std::int32_t t, soa_vector<N, std::int32_t>& dst)
+    {
+        auto [in, out] = detail::soa_pointers(a, dst);
+        for (unsigned j = 0; j < N; ++j)
+        {
+            const auto* x = in[j];
+            const auto* y = b.component(j);
+            for (std::size_t i = 0; i < a.size(); ++i) out[j][i] = x[i] + fixed_mul(y[i] - x[i], t);
+        }
+    }
+}
@@ -0,0 +1,247 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <array>
+#include <vector>
+#include <bitset>
+#include <algorithm>
+#include <limits>
+#include <jw/video/pixel.h>
+
+namespace jw
+{
+    namespace video
+    {
+        enum class dither_mode
+        {
+            none,               // truncate, same as pixel::cast_to
+            ordered,            // 8x8 Bayer matrix
+            error_diffusion     // Sierra Lite, two row buffers
+        };
+
+        // Maps colours onto an 8-bit palette, as used with vga::set_palette().
+        // Nearest-colour lookups are cached in a 15-bit (5:5:5) inverse colour table, which is filled lazily.
+        struct inverse_palette
+        {
+            inverse_palette(const px32n* begin, const px32n* end) : pal(begin, end) { }
+            inverse_palette(const std::vector<px32n>& p) : pal(p) { }
+
+            // Pre-calculate the full inverse colour table.
+            void fill() { for (std::size_t i = 0; i < table.size(); ++i) lookup(i); }
+
+            // Find the nearest palette index for a colour.
+            byte find(const px32n& p) { return lookup(((p.r >> 3) << 10) | ((p.g >> 3) << 5) | (p.b >> 3)); }
+            byte find(std::uint8_t r, std::uint8_t g, std::uint8_t b) { return find(px32n { r, g, b }); }
+
+            const px32n& operator[](std::size_t i) const noexcept { return pal[i]; }
+            const std::vector<px32n>& palette() const noexcept { return pal; }
+
+        private:
+            byte lookup(std::size_t i)
+            {
+                if (__builtin_expect(valid[i], true)) return table[i];
+                const int r = ((i >> 10) & 0x1f) * 255 / 31;
+                const int g = ((i >> 5) & 0x1f) * 255 / 31;
+                const int b = (i & 0x1f) * 255 / 31;
+                std::size_t best { 0 };
+                int best_distance { std::numeric_limits<int>::max() };
+                for (std::size_t j = 0; j < std::min(pal.size(), std::size_t { 256 }); ++j)
+                {
+                    const int dr = r - pal[j].r, dg = g - pal[j].g, db = b - pal[j].b;
+                    const int d = 3 * dr * dr + 4 * dg * dg + 2 * db * db;
+                    if (d < best_distance) { best = j; best_distance = d; }
+                }
+                valid[i] = true;
+                return table[i] = best;
+            }
+
+            std::vector<px32n> pal;
+            std::array<byte, 0x8000> table;
+            std::bitset<0x8000> valid { };
+        };
+
+        namespace detail
+        {
+            using dither_vector [[gnu::vector_size(16)]] = float;     // b, g, r, a
+
+            // 8x8 Bayer threshold matrix, values 0..63.
+            constexpr std::array<std::array<byte, 8>, 8> bayer_matrix = []
+            {
+                std::array<std::array<byte, 8>, 8> m { };
+                for (unsigned y = 0; y < 8; ++y)
+                    for (unsigned x = 0; x < 8; ++x)
+                    {
+                        const unsigned xy = x ^ y;
+                        byte v { 0 };
+                        for (unsigned bit = 0; bit < 3; ++bit)
+                        {
+                            v |= ((xy >> bit) & 1) << (5 - 2 * bit);
+                            v |= ((y >> bit) & 1) << (4 - 2 * bit);
+                        }
+                        m[y][x] = v;
+                    }
+                return m;
+            }();
+
+            // Threshold in the range [-0.5, 0.5).
+            constexpr float bayer_threshold(std::size_t x, std::size_t y) noexcept { return (bayer_matrix[y & 7][x & 7] + 0.5f) / 64.0f - 0.5f; }
+
+            template<typename P> struct dither_target;
+
+            // Quantizes to the channel depth of a pixel format.
+            template<typename P>
+            struct dither_target<pixel<P>>
+            {
+                static_assert(std::is_integral_v<typename P::T>, "Dithering to floating-point formats is pointless.");
+                static constexpr dither_vector max { static_cast<float>(P::bx), static_cast<float>(P::gx), static_cast<float>(P::rx), static_cast<float>(P::ax) };
+
+                dither_target(inverse_palette*) { }
+
+                static constexpr unsigned quantize(float v, unsigned m) noexcept
+                {
+                    return static_cast<unsigned>(std::clamp(v + 0.5f, 0.0f, static_cast<float>(m)));
+                }
+
+                // v is scaled to the channel maximum. Returns the quantization error in q.
+                void operator()(pixel<P>& dst, dither_vector v, dither_vector& q) noexcept
+                {
+                    const unsigned b = quantize(v[0], P::bx), g = quantize(v[1], P::gx), r = quantize(v[2], P::rx), a = quantize(v[3], P::ax);
+                    q = v - dither_vector { static_cast<float>(b), static_cast<float>(g), static_cast<float>(r), static_cast<float>(a) };
+                    dst = pixel<P> { r, g, b, a };
+                }
+            };
+
+            // Quantizes to the nearest palette colour.
+            template<>
+            struct dither_target<px8>
+            {
+                static constexpr dither_vector max { 255, 255, 255, 0 };
+
+                dither_target(inverse_palette* p) : pal(p) { }
+
+                // Assigns value directly, px8::operator= treats index 0 as transparent.
+                void operator()(px8& dst, dither_vector v, dither_vector& q) noexcept
+                {
+                    auto c = [](float x) { return static_cast<std::uint8_t>(std::clamp(x + 0.5f, 0.0f, 255.0f)); };
+                    dst.value = pal->find(c(v[2]), c(v[1]), c(v[0]));
+                    const auto& p = (*pal)[dst.value];
+                    q = v - dither_vector { static_cast<float>(p.b), static_cast<float>(p.g), static_cast<float>(p.r), 0 };
+                }
+
+            private:
+                inverse_palette* pal;
+            };
+        }
+
+        // Converts rows of pixels to a low-bit format (or to an 8-bit palette) with dithering.
+        // Sources are converted to floating-point in small chunks using pixel::convert_span, so MMX/SSE
+        // state is only switched once per chunk.
+        // Error diffusion keeps state between rows, so rows must be passed in order, top to bottom.
+        template<typename P>
+        struct dither
+        {
+            // Dither to a pixel<> format.
+            dither(std::size_t w, dither_mode m = dither_mode::ordered) : dither(w, m, nullptr)
+            {
+                static_assert(not std::is_same_v<P, px8>, "Dithering to px8 requires an inverse_palette.");
+            }
+
+            // Dither to an 8-bit palette. The ordered dither spread is scaled by palette_spread (range 0..1),
+            // which should roughly match the distance between palette colours.
+            dither(std::size_t w, inverse_palette& p, dither_mode m = dither_mode::ordered, float palette_spread = 1.0f / 8)
+                : dither(w, m, &p)
+            {
+                spread = palette_spread * 255;
+            }
+
+            // Convert one row. For ordered dithering, x and y select the position in the threshold matrix.
+            template<typename U>
+            void operator()(const pixel<U>* src, P* dst, std::size_t y, std::size_t x = 0)
+            {
+                if constexpr (std::is_same_v<P, px8>) row(src, dst, x, y);
+                else if (mode == dither_mode::none) P::convert_span(src, dst, width);
+                else row(src, dst, x, y);
+            }
+
+            // Clear accumulated error, to start a new image.
+            void reset() noexcept
+            {
+                std::fill(error[0].begin(), error[0].end(), detail::dither_vector { });
+                std::fill(error[1].begin(), error[1].end(), detail::dither_vector { });
+            }
+
+            std::size_t size() const noexcept { return width; }
+
+        private:
+            using vector = detail::dither_vector;
+            static constexpr std::size_t chunk_size { 64 };
+
+            dither(std::size_t w, dither_mode m, inverse_palette* p) : width(w), mode(m), target(p)
+            {
+                if (mode == dither_mode::error_diffusion)
+                {
+                    error[0].resize(width + 2);
+                    error[1].resize(width + 2);
+                }
+            }
+
+            template<typename U>
+            void row(const pixel<U>* src, P* dst, std::size_t x0, std::size_t y)
+            {
+                alignas(0x10) std::array<pxf, chunk_size> buffer;
+                auto* current = error[y & 1].data();
+                auto* next = error[~y & 1].data();
+                if (mode == dither_mode::error_diffusion) std::fill_n(next, width + 2, vector { });
+
+                for (std::size_t i = 0; i < width; i += chunk_size)
+                {
+                    const auto n = std::min(chunk_size, width - i);
+                    pxf::convert_span(src + i, buffer.data(), n);
+                    for (std::size_t j = 0; j < n; ++j)
+                    {
+                        const auto x = i + j;
+                        vector v = *reinterpret_cast<const vector*>(&buffer[j]);
+                        if constexpr (not pixel<U>::has_alpha()) v[3] = 1;
+                        v *= target.max;
+                        vector q;
+                        switch (mode)
+                        {
+                        case dither_mode::ordered:
+                            v += detail::bayer_threshold(x0 + x, y) * spread;
+                            target(dst[x], v, q);
+                            break;
+
+                        case dither_mode::error_diffusion:
+                            // Sierra Lite:  . * 2
+                            //               1 1 .   (/4)
+                            v += current[x + 1];
+                            target(dst[x], v, q);
+                            current[x + 2] += q * 0.5f;
+                            next[x] += q * 0.25f;
+                            next[x + 1] += q * 0.25f;
+                            break;
+
+                        default:
+                            target(dst[x], v, q);
+                        }
+                    }
+                }
+                if constexpr (mmx) _mm_empty();
+            }
+
+            std::size_t width;
+            dither_mode mode;
+            detail::dither_target<P> target;
+            float spread { 1.0f };
+            std::array<std::vector<vector>, 2> error;
+        };
+
+        // Convert a single row with ordered dithering.
+        template<typename P, typename U>
+        inline void ordered_dither(const pixel<U>* src, pixel<P>* dst, std::size_t n, std::size_t x, std::size_t y)
+        {
+            dither<pixel<P>> { n, dither_mode::ordered }(src, dst, y, x);
+        }
+    }
+}
@@ -0,0 +1,137 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <vector>
+#include <array>
+#include <string_view>
+#include <jw/video/pixel.h>
+#include <jw/video/rect.h>
+#include <jw/video/rasterizer.h>
+#include <jw/matrix.h>
+
+namespace jw
+{
+    namespace video
+    {
+        // Monochrome bitmap font. Each glyph row is stored MSB first, padded to whole bytes.
+        struct bitmap_font
+        {
+            bitmap_font(std::size_t width, std::size_t height, std::vector<byte> bits, std::size_t first_char = 0)
+                : w(width), h(height), pitch((width + 7) / 8), first(first_char), data(std::move(bits)) { }
+
+            // Load the 8x8, 8x14 or 8x16 font from the VGA BIOS (INT 10h/1130h).
+            static bitmap_font vga_rom(std::size_t height = 16);
+
+            bool test(std::uint8_t c, std::size_t x, std::size_t y) const noexcept
+            {
+                if (c < first or c >= first + size()) return false;
+                return data[((c - first) * h + y) * pitch + x / 8] & (0x80 >> (x & 7));
+            }
+
+            std::size_t width() const noexcept { return w; }
+            std::size_t height() const noexcept { return h; }
+            std::size_t size() const noexcept { return data.size() / (h * pitch); }     // number of glyphs
+
+        private:
+            std::size_t w, h, pitch, first;
+            std::vector<byte> data;
+        };
+
+        // Pre-rendered glyphs for one font and colour, in the destination pixel format.
+        // With an opaque background, glyphs are drawn by copying rows out of an atlas.
+        // With a transparent background, glyphs are drawn as precomputed runs of foreground pixels.
+        template<typename P>
+        struct glyph_atlas
+        {
+            // Character positions of a laid-out string. Can be reused to draw the same text repeatedly.
+            struct layout
+            {
+                std::vector<std::pair<vector2i, std::uint8_t>> glyphs;
+                vector2i size;
+            };
+
+            glyph_atlas(const bitmap_font& f, const pixel<P>& fg, const pixel<P>& bg, bool opaque_background = false)
+                : w(f.width()), h(f.height()), opaque(opaque_background), fg_color(fg)
+                , atlas(vector2i { static_cast<std::int32_t>(16 * w), static_cast<std::int32_t>(16 * h) })
+            {
+                runs.reserve(256 * h);
+                for (std::size_t c = 0; c < 256; ++c)
+                {
+                    run_index[c] = runs.size();
+                    auto cell = cell_pos(c);
+                    for (std::size_t y = 0; y < h; ++y)
+                    {
+                        for (std::size_t x = 0; x < w; ++x)
+                            atlas(cell + vector2i { x, y }) = f.test(c, x, y) ? fg : bg;
+                        for (std::size_t x = 0; x < w;)
+                        {
+                            while (x < w and not f.test(c, x, y)) ++x;
+                            auto x0 = x;
+                            while (x < w and f.test(c, x, y)) ++x;
+                            if (x > x0) runs.push_back({ static_cast<std::uint16_t>(y), static_cast<std::uint16_t>(x0), static_cast<std::uint16_t>(x - x0) });
+                        }
+                    }
+                }
+                run_index[256] = runs.size();
+            }
+
+            // Lay out a string. Handles '\n' and '\t' (8 columns).
+            layout make_layout(std::string_view s) const
+            {
+                layout l { };
+                l.glyphs.reserve(s.size());
+                vector2i p { 0, 0 };
+                std::int32_t max_x { 0 };
+                for (std::uint8_t c : s)
+                {
+                    if (c == '\n') { p = { 0, p[1] + static_cast<std::int32_t>(h) }; continue; }
+                    if (c == '\t') { p[0] = (p[0] / (8 * w) + 1) * 8 * w; continue; }
+                    if (c != ' ' or opaque) l.glyphs.emplace_back(p, c);
+                    p[0] += w;
+                    max_x = std::max(max_x, p[0]);
+                }
+                l.size = { max_x, p[1] + static_cast<std::int32_t>(h) };
+                return l;
+            }
+
+            void draw(matrix<pixel<P>>& dst, vector2i pos, const layout& l) const
+            {
+                for (auto& g : l.glyphs) draw(dst, pos + g.first, g.second);
+            }
+
+            void draw(matrix<pixel<P>>& dst, vector2i pos, std::string_view s) const { draw(dst, pos, make_layout(s)); }
+
+            void draw(matrix<pixel<P>>& dst, vector2i pos, std::uint8_t c) const
+            {
+                if (opaque)
+                {
+                    auto cell = cell_pos(c);
+                    blit(dst, pos, atlas, rect { cell, cell + vector2i { w, h } });
+                    return;
+                }
+                const bool clip = pos[0] < 0 or pos[1] < 0 or pos[0] + static_cast<std::ptrdiff_t>(w) > dst.width() or pos[1] + static_cast<std::ptrdiff_t>(h) > dst.height();
+                for (auto i = run_index[c]; i < run_index[c + 1]; ++i)
+                {
+                    const auto& r = runs[i];
+                    if (__builtin_expect(not clip, true)) std::fill_n(dst.data() + (pos[1] + r.y) * dst.width() + pos[0] + r.x, r.size, fg_color);
+                    else fill_span(dst, pos[0] + r.x, pos[0] + r.x + r.size, pos[1] + r.y, fg_color);
+                }
+            }
+
+            vector2i glyph_size() const noexcept { return { w, h }; }
+
+        private:
+            struct run { std::uint16_t y, x, size; };
+
+            vector2i cell_pos(std::size_t c) const noexcept { return { (c % 16) * w, (c / 16) * h }; }
+
+            std::size_t w, h;
+            bool opaque;
+            pixel<P> fg_color;
+            matrix_container<pixel<P>> atlas;
+            std::vector<run> runs { };
+            std::array<std::size_t, 257> run_index;
+        };
+    }
+}
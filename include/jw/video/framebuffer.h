@@ -0,0 +1,178 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <jw/video/vbe.h>
+#include <jw/video/pixel.h>
+#include <jw/video/rect.h>
+#include <jw/dpmi/memory.h>
+#include <jw/chrono/chrono.h>
+#include <jw/matrix.h>
+#include <jw/vector.h>
+
+namespace jw
+{
+    namespace video
+    {
+        struct present_stats
+        {
+            std::size_t bytes { 0 };            // bytes written to video memory
+            std::size_t spans { 0 };            // number of row segments written
+            std::size_t bank_switches { 0 };
+            chrono::tsc::duration time { };     // time spent in present()
+            std::size_t frames { 0 };           // total number of calls to present()
+        };
+
+        namespace detail
+        {
+            // Maps the video memory of the current VBE mode, either through the linear framebuffer or a bank window.
+            struct framebuffer_output
+            {
+                enum format_t { indexed8, rgb555, rgb565, rgb888, xrgb8888 };
+
+                framebuffer_output(vbe& v);
+
+                // Returns a pointer to the linear framebuffer, or nullptr in banked modes.
+                byte* lfb() noexcept { return lfb_mem ? lfb_mem->get_ptr() : nullptr; }
+
+                // Write to video memory through the bank window. Switches banks only when needed.
+                void write(std::size_t offset, const byte* src, std::size_t size);
+
+                format_t format;
+                vector2i resolution;
+                std::size_t pitch;
+                std::size_t bytes_per_pixel;
+                std::size_t bank_switches { 0 };
+
+            private:
+                vbe& v;
+                std::unique_ptr<dpmi::device_memory<byte>> lfb_mem;
+                std::unique_ptr<dpmi::mapped_dos_memory<byte>> window;
+                std::size_t granularity { 0 };
+                std::size_t window_size { 0 };
+                std::size_t current_bank { static_cast<std::size_t>(-1) };
+                bool window_b { false };
+            };
+        }
+
+        // Back buffer in system memory, presented to the screen in the current VBE mode.
+        // Only regions marked dirty are copied, converted to the screen's pixel format on the way.
+        // Rows are written in order of their address, so that in banked modes each bank is switched in only once.
+        // P is any pixel<> type, or px8 for 8-bit indexed modes.
+        template<typename P>
+        struct framebuffer
+        {
+            framebuffer(vbe& v, std::size_t max_dirty_rects = 16)
+                : out(v), buf(out.resolution), max_rects(max_dirty_rects)
+            {
+                if constexpr (std::is_same_v<P, px8>)
+                {
+                    if (out.format != detail::framebuffer_output::indexed8) throw vbe::invalid_in_current_video_mode { "framebuffer<px8> requires an 8-bit mode." };
+                }
+                else if (out.format == detail::framebuffer_output::indexed8) throw vbe::invalid_in_current_video_mode { "framebuffer<pixel> requires a direct colour mode." };
+                row.resize(out.resolution.x() * sizeof(px32n));
+                mark_all_dirty();
+            }
+
+            matrix<P>& buffer() noexcept { return buf; }
+            const matrix<P>& buffer() const noexcept { return buf; }
+
+            // Mark a region to be copied on the next present().
+            void mark_dirty(rect r)
+            {
+                r = r.clipped({ { 0, 0 }, buf.size() });
+                if (r.empty()) return;
+                for (auto i = dirty.begin(); i != dirty.end();)
+                {
+                    // Merge when the union does not cover more than both rectangles separately.
+                    auto m = r.merged(*i);
+                    if (m.area() <= r.area() + i->area())
+                    {
+                        r = m;
+                        dirty.erase(i);
+                        i = dirty.begin();
+                    }
+                    else ++i;
+                }
+                if (dirty.size() >= max_rects)
+                {
+                    for (auto& i : dirty) r = r.merged(i);
+                    dirty.clear();
+                }
+                dirty.push_back(r);
+            }
+            void mark_dirty(vector2i pos, vector2i size) { mark_dirty(rect { pos, pos + size }); }
+            void mark_all_dirty() { dirty.clear(); dirty.push_back({ { 0, 0 }, buf.size() }); }
+            const std::vector<rect>& get_dirty() const noexcept { return dirty; }
+
+            // Select the video page to write to, for page flipping.
+            void set_page(std::size_t page) noexcept { page_offset = page * out.pitch * out.resolution.y(); }
+
+            // Copy all dirty regions to video memory.
+            void present()
+            {
+                auto t0 = chrono::tsc::now();
+                auto switches = out.bank_switches;
+                stats.bytes = 0;
+                stats.spans = 0;
+
+                spans.clear();
+                for (auto& r : dirty)
+                    for (auto y = r.topleft.y(); y < r.bottomright.y(); ++y)
+                        spans.push_back({ y, r.topleft.x(), r.bottomright.x() });
+                dirty.clear();
+                std::sort(spans.begin(), spans.end(), [](const auto& a, const auto& b) { return a.y < b.y or (a.y == b.y and a.x0 < b.x0); });
+
+                for (auto& s : spans)
+                {
+                    const auto* src = buffer().data() + s.y * buf.width() + s.x0;
+                    const std::size_t n = s.x1 - s.x0;
+                    const std::size_t offset = page_offset + s.y * out.pitch + s.x0 * out.bytes_per_pixel;
+                    if constexpr (std::is_same_v<P, px8>) write_span<px8>(src, n, offset);
+                    else switch (out.format)
+                    {
+                    case detail::framebuffer_output::rgb555: write_span<px16n>(src, n, offset); break;
+                    case detail::framebuffer_output::rgb565: write_span<px16>(src, n, offset); break;
+                    case detail::framebuffer_output::rgb888: write_span<px24>(src, n, offset); break;
+                    default: write_span<px32n>(src, n, offset); break;
+                    }
+                    ++stats.spans;
+                }
+
+                stats.bank_switches = out.bank_switches - switches;
+                stats.time = chrono::tsc::now() - t0;
+                ++stats.frames;
+            }
+
+            // Statistics from the last call to present().
+            const present_stats& get_stats() const noexcept { return stats; }
+
+        private:
+            struct span { std::ptrdiff_t y, x0, x1; };
+
+            template<typename F>
+            void write_span(const P* src, std::size_t n, std::size_t offset)
+            {
+                auto* lfb = out.lfb();
+                auto* dst = reinterpret_cast<F*>(lfb != nullptr ? lfb + offset : row.data());
+                if constexpr (std::is_same_v<P, F>) std::memcpy(static_cast<void*>(dst), src, n * sizeof(F));     // px8::operator= skips index 0
+                else F::convert_span(src, dst, n);
+                if (lfb == nullptr) out.write(offset, row.data(), n * sizeof(F));
+                stats.bytes += n * sizeof(F);
+            }
+
+            detail::framebuffer_output out;
+            matrix_container<P> buf;
+            std::size_t max_rects;
+            std::vector<rect> dirty { };
+            std::vector<span> spans { };
+            std::vector<byte> row { };
+            std::size_t page_offset { 0 };
+            present_stats stats { };
+        };
+    }
+}
@@ -3,10 +3,14 @@
 /* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
 
 #pragma once
+#include <algorithm>
 #include <type_traits>
 #include <vector>
 #include <mmintrin.h>
 #include <xmmintrin.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <jw/common.h>
 #include <jw/math.h>
 
@@ -62,6 +66,11 @@ namespace jw
 
         struct [[gnu::packed]] px { };
 
+        struct bgra_ffff;
+        struct bgra_fff0;
+        struct bgra_8888;
+        struct bgra_8880;
+
         template<typename P>
         struct alignas(P) [[gnu::packed, gnu::may_alias]] pixel : public P, public px
         {
@@ -156,7 +165,269 @@ namespace jw
                 return *this;
             }
 
+            // Convert a span of pixels to this format. MMX state is cleared only once, at the end.
+            template<typename U>
+            static void convert_span(const pixel<U>* src, pixel* dst, std::size_t n) noexcept
+            {
+                if constexpr (std::is_same_v<P, U>) std::copy_n(src, n, dst);
+                else
+                {
+                    std::size_t i { 0 };
+                    if constexpr (sse2) i = sse2_convert_span(src, dst, n);
+                    if constexpr (mmx) i += mmx_convert_span(src + i, dst + i, n - i);
+                    for (; i < n; ++i)
+                    {
+                        if constexpr (sse and (std::is_floating_point_v<typename P::T> or std::is_floating_point_v<typename U::T>))
+                            dst[i] = m128_noemms(pixel<U>::template m128_cast_to<P>(src[i].m128()));
+                        else if constexpr (mmx and (sse or (std::is_integral_v<typename P::T> and std::is_integral_v<typename U::T>)))
+                            dst[i] = m64_noemms(pixel<U>::template m64_cast_to<P>(src[i].m64()));
+                        else dst[i] = src[i].template cast_to<P>();
+                    }
+                    if constexpr (mmx) _mm_empty();
+                }
+            }
+
+            // Blend a span of pixels (with premultiplied alpha) onto this format.
+            template<typename U>
+            static void blend_span(pixel* dst, const pixel<U>* src, std::size_t n) noexcept
+            {
+                if constexpr (not pixel<U>::has_alpha()) convert_span(src, dst, n);
+                else
+                {
+                    std::size_t i { 0 };
+                    if constexpr (mmx) i = mmx_blend_span(dst, src, n);
+                    for (; i < n; ++i)
+                    {
+                        if constexpr (sse and (std::is_floating_point_v<typename P::T> or std::is_floating_point_v<typename U::T>))
+                            dst[i] = m128_noemms(dst[i].template m128_blend<U>(dst[i].m128(), src[i].m128()));
+                        else if constexpr (mmx and std::is_integral_v<typename P::T> and std::is_integral_v<typename U::T>)
+                            dst[i] = m64_noemms(dst[i].template m64_blend<U>(dst[i].m64(), src[i].m64()));
+                        else dst[i].blend(src[i]);
+                    }
+                    if constexpr (mmx) _mm_empty();
+                }
+            }
+
+            // Premultiply alpha for a span of pixels.
+            static void premultiply_span(pixel* p, std::size_t n) noexcept
+            {
+                if constexpr (has_alpha())
+                {
+                    std::size_t i { 0 };
+                    if constexpr (mmx) i = mmx_premultiply_span(p, n);
+                    for (; i < n; ++i)
+                    {
+                        if constexpr (sse and std::is_floating_point_v<typename P::T>) p[i] = m128(m128_premul(p[i].m128()));
+                        else if constexpr (mmx and not std::is_floating_point_v<typename P::T>) p[i] = m64_noemms(m64_premul(p[i].m64()));
+                        else p[i].premultiply_alpha();
+                    }
+                    if constexpr (mmx) _mm_empty();
+                }
+            }
+
         private:
+            // SSE2 kernels for conversion between float and 32-bit formats, four pixels at a time.
+            // Returns the number of pixels converted.
+            template <typename U>
+            static std::size_t sse2_convert_span(const pixel<U>* src, pixel* dst, std::size_t n) noexcept
+            {
+                std::size_t i { 0 };
+#               ifdef __SSE2__
+                constexpr bool from_float = std::is_same_v<U, bgra_ffff> or std::is_same_v<U, bgra_fff0>;
+                constexpr bool to_float = std::is_same_v<P, bgra_ffff> or std::is_same_v<P, bgra_fff0>;
+                constexpr bool from_32 = std::is_same_v<U, bgra_8888> or std::is_same_v<U, bgra_8880>;
+                constexpr bool to_32 = std::is_same_v<P, bgra_8888> or std::is_same_v<P, bgra_8880>;
+                constexpr bool alpha_ok = has_alpha() == pixel<U>::has_alpha() or not has_alpha();
+
+                if constexpr (from_float and to_32 and alpha_ok)
+                {
+                    const auto scale = _mm_set1_ps(255.0f);
+                    for (; i + 4 <= n; i += 4)
+                    {
+                        auto* s = reinterpret_cast<const __m128*>(src + i);
+                        auto a = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(s[0], scale)), _mm_cvtps_epi32(_mm_mul_ps(s[1], scale)));
+                        auto b = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(s[2], scale)), _mm_cvtps_epi32(_mm_mul_ps(s[3], scale)));
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(a, b));
+                    }
+                }
+                else if constexpr (from_32 and to_float and alpha_ok)
+                {
+                    const auto scale = _mm_set1_ps(1.0f / 255.0f);
+                    const auto zero = _mm_setzero_si128();
+                    for (; i + 4 <= n; i += 4)
+                    {
+                        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                        auto lo = _mm_unpacklo_epi8(v, zero);
+                        auto hi = _mm_unpackhi_epi8(v, zero);
+                        auto* d = reinterpret_cast<__m128*>(dst + i);
+                        d[0] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale);
+                        d[1] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale);
+                        d[2] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale);
+                        d[3] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale);
+                    }
+                }
+#               endif
+                return i;
+            }
+
+            // MMX kernels for 16-bit and 32-bit integer formats, four pixels at a time. Pixels are split into
+            // one register per channel, holding four 16-bit lanes scaled to 0-255, so all channels of four
+            // pixels are processed with a single instruction each. Scaling is rounded exactly, by
+            // multiplication only. Each returns the number of pixels processed.
+            template <typename U>
+            static std::size_t mmx_convert_span(const pixel<U>* src, pixel* dst, std::size_t n) noexcept
+            {
+                if constexpr (mmx_planar() and pixel<U>::mmx_planar())
+                {
+                    return mmx_span(dst, src, n, [](pixel* d, const pixel<U>* s)
+                    {
+                        __m64 c[4];
+                        pixel<U>::mmx_load4(s, c);
+                        mmx_store4(d, c);
+                    });
+                }
+                else return 0;
+            }
+
+            template <typename U>
+            static std::size_t mmx_blend_span(pixel* dst, const pixel<U>* src, std::size_t n) noexcept
+            {
+                if constexpr (mmx_planar() and pixel<U>::mmx_planar() and pixel<U>::has_alpha())
+                {
+                    return mmx_span(dst, src, n, [](pixel* d, const pixel<U>* s)
+                    {
+                        __m64 dc[4], sc[4];
+                        mmx_load4(d, dc);
+                        pixel<U>::mmx_load4(s, sc);
+                        const auto a = _mm_xor_si64(sc[3], _mm_set1_pi16(0xff));
+                        for (auto c = 0; c < 4; ++c)
+                            dc[c] = mmx_clamp(_mm_add_pi16(mmx_div255(_mm_mullo_pi16(dc[c], a)), sc[c]));
+                        mmx_store4(d, dc);
+                    });
+                }
+                else return 0;
+            }
+
+            static std::size_t mmx_premultiply_span(pixel* p, std::size_t n) noexcept
+            {
+                if constexpr (mmx_planar())
+                {
+                    return mmx_span(p, p, n, [](pixel* d, const pixel*)
+                    {
+                        __m64 c[4];
+                        mmx_load4(d, c);
+                        for (auto i = 0; i < 3; ++i) c[i] = mmx_div255(_mm_mullo_pi16(c[i], c[3]));
+                        mmx_store4(d, c);
+                    });
+                }
+                else return 0;
+            }
+
+            // Apply a four-pixel kernel over a span. The remainder is padded out to four pixels, so that
+            // every pixel in the span is rounded the same way.
+            template <typename U, typename F>
+            static std::size_t mmx_span(pixel* dst, const pixel<U>* src, std::size_t n, F&& kernel) noexcept
+            {
+                std::size_t i { 0 };
+                for (; i + 4 <= n; i += 4) kernel(dst + i, src + i);
+                if (i < n)
+                {
+                    pixel d[4] { };
+                    pixel<U> s[4] { };
+                    std::copy(dst + i, dst + n, d);
+                    std::copy(src + i, src + n, s);
+                    kernel(d, s);
+                    std::copy(d, d + (n - i), dst + i);
+                }
+                return n;
+            }
+
+            static constexpr bool mmx_planar() noexcept
+            {
+                if constexpr (std::is_floating_point_v<typename P::T>) return false;
+                else return std::is_same_v<P, bgra_8888> or std::is_same_v<P, bgra_8880> or sizeof(pixel) == 2;
+            }
+
+            // Load four pixels as channel planes (b, g, r, a). Formats without alpha are loaded as opaque.
+            static void mmx_load4(const pixel* p, __m64 (&c)[4]) noexcept
+            {
+                if constexpr (sizeof(pixel) == 4)
+                {
+                    const auto lo = reinterpret_cast<const __m64*>(p)[0];
+                    const auto hi = reinterpret_cast<const __m64*>(p)[1];
+                    const auto mask = _mm_set1_pi32(0xff);
+                    for (auto i = 0; i < 3; ++i)
+                        c[i] = _mm_packs_pi32(_mm_and_si64(_mm_srli_pi32(lo, i * 8), mask), _mm_and_si64(_mm_srli_pi32(hi, i * 8), mask));
+                    if constexpr (has_alpha()) c[3] = _mm_packs_pi32(_mm_srli_pi32(lo, 24), _mm_srli_pi32(hi, 24));
+                }
+                else
+                {
+                    const auto v = *reinterpret_cast<const __m64*>(p);
+                    c[0] = mmx_expand<P::bx>(_mm_and_si64(v, _mm_set1_pi16(P::bx)));
+                    c[1] = mmx_expand<P::gx>(_mm_and_si64(_mm_srli_pi16(v, g_shift()), _mm_set1_pi16(P::gx)));
+                    c[2] = mmx_expand<P::rx>(_mm_and_si64(_mm_srli_pi16(v, r_shift()), _mm_set1_pi16(P::rx)));
+                    if constexpr (has_alpha()) c[3] = mmx_expand<P::ax>(_mm_and_si64(_mm_srli_pi16(v, a_shift()), _mm_set1_pi16(P::ax)));
+                }
+                if constexpr (not has_alpha()) c[3] = _mm_set1_pi16(0xff);
+            }
+
+            // Store four pixels from channel planes, which must be in the range 0-255.
+            static void mmx_store4(pixel* p, const __m64 (&c)[4]) noexcept
+            {
+                if constexpr (sizeof(pixel) == 4)
+                {
+                    const auto bg = _mm_or_si64(c[0], _mm_slli_pi16(c[1], 8));
+                    const auto ra = has_alpha() ? _mm_or_si64(c[2], _mm_slli_pi16(c[3], 8)) : c[2];
+                    reinterpret_cast<__m64*>(p)[0] = _mm_unpacklo_pi16(bg, ra);
+                    reinterpret_cast<__m64*>(p)[1] = _mm_unpackhi_pi16(bg, ra);
+                }
+                else
+                {
+                    auto v = mmx_reduce<P::bx>(c[0]);
+                    v = _mm_or_si64(v, _mm_slli_pi16(mmx_reduce<P::gx>(c[1]), g_shift()));
+                    v = _mm_or_si64(v, _mm_slli_pi16(mmx_reduce<P::rx>(c[2]), r_shift()));
+                    if constexpr (has_alpha()) v = _mm_or_si64(v, _mm_slli_pi16(mmx_reduce<P::ax>(c[3]), a_shift()));
+                    *reinterpret_cast<__m64*>(p) = v;
+                }
+            }
+
+            // Scale from 0-max to 0-255: (2 * 255 * v + max) / (2 * max), with the division done by mulhi.
+            template <unsigned max>
+            static __m64 mmx_expand(__m64 v) noexcept
+            {
+                if constexpr (max == 1) return _mm_mullo_pi16(v, _mm_set1_pi16(0xff));
+                else
+                {
+                    constexpr auto shift = [] { unsigned s = 0; while (((1u << (17 + s)) + 2 * max - 1) / (2 * max) < 0x8000) ++s; return s; }();
+                    constexpr auto k = ((1u << (16 + shift)) + 2 * max - 1) / (2 * max);
+                    v = _mm_add_pi16(_mm_mullo_pi16(v, _mm_set1_pi16(2 * 255)), _mm_set1_pi16(max));
+                    return _mm_srli_pi16(_mm_mulhi_pi16(v, _mm_set1_pi16(k)), shift);
+                }
+            }
+
+            // Scale from 0-255 to 0-max.
+            template <unsigned max>
+            static __m64 mmx_reduce(__m64 v) noexcept { return mmx_div255(_mm_mullo_pi16(v, _mm_set1_pi16(max))); }
+
+            // Divide by 255, rounded, for values up to 255 * 255.
+            static __m64 mmx_div255(__m64 v) noexcept
+            {
+                v = _mm_add_pi16(v, _mm_set1_pi16(0x80));
+                return _mm_srli_pi16(_mm_add_pi16(v, _mm_srli_pi16(v, 8)), 8);
+            }
+
+            // Clamp to 255.
+            static __m64 mmx_clamp(__m64 v) noexcept
+            {
+                const auto x = _mm_set1_pi16(0xff00);
+                return _mm_subs_pu16(_mm_adds_pu16(v, x), x);
+            }
+
+            static constexpr unsigned bit_width(unsigned max) noexcept { unsigned n = 0; for (; max != 0; max >>= 1) ++n; return n; }
+            static constexpr unsigned g_shift() noexcept { return bit_width(P::bx); }
+            static constexpr unsigned r_shift() noexcept { return g_shift() + bit_width(P::gx); }
+            static constexpr unsigned a_shift() noexcept { return r_shift() + bit_width(P::rx); }
+
             template <typename U>
             constexpr pixel<U> cast_to() const
             {
@@ -179,22 +450,25 @@ namespace jw
             }
 
             static constexpr pixel m64(auto value) noexcept // V4HI
+            {
+                auto result = m64_noemms(value);
+                _mm_empty();
+                return result;
+            }
+
+            static constexpr pixel m64_noemms(auto value) noexcept // V4HI
             {
                 static_assert(not std::is_floating_point_v<typename P::T>);
                 auto v = _mm_packs_pu16(value, _mm_setzero_si64());
                 if constexpr (byte_aligned())
                 {
                     auto v2 = _mm_cvtsi64_si32(v);
-                    pixel result { *reinterpret_cast<pixel*>(&v2) };
-                    _mm_empty();
-                    return result;
+                    return *reinterpret_cast<pixel*>(&v2);
                 }
                 else
                 {
                     auto v2 = reinterpret_cast<V<8, byte>&>(v);
-                    pixel result { v2[2], v2[1], v2[0], v2[3] };
-                    _mm_empty();
-                    return result;
+                    return pixel { v2[2], v2[1], v2[0], v2[3] };
                 }
             }
 
@@ -215,6 +489,12 @@ namespace jw
                 else return m64(_mm_cvtps_pi16(value));
             }
 
+            static constexpr pixel m128_noemms(__m128 value) noexcept  // V4SF
+            {
+                if constexpr (std::is_floating_point_v<typename P::T>) return *reinterpret_cast<pixel*>(&value);
+                else return m64_noemms(_mm_cvtps_pi16(value));
+            }
+
             constexpr __m128 m128() const noexcept  // V4SF
             {
                 if constexpr (std::is_floating_point_v<typename P::T>) return *reinterpret_cast<const __m128*>(this);
@@ -670,6 +950,18 @@ namespace jw
         static_assert(sizeof(px8n  ) ==  1);
         static_assert(sizeof(pxvga ) ==  4);
 
+        // Convert a span of pixels from one format to another.
+        template<typename P, typename U>
+        inline void convert(const pixel<U>* src, pixel<P>* dst, std::size_t n) noexcept { pixel<P>::convert_span(src, dst, n); }
+
+        // Alpha-blend a span of pixels onto another.
+        template<typename P, typename U>
+        inline void blend_span(pixel<P>* dst, const pixel<U>* src, std::size_t n) noexcept { pixel<P>::blend_span(dst, src, n); }
+
+        // Premultiply alpha for a span of pixels.
+        template<typename P>
+        inline void premultiply_span(pixel<P>* p, std::size_t n) noexcept { pixel<P>::premultiply_span(p, n); }
+
         inline auto generate_px8n_palette()
         {
             std::vector<px32n> result;
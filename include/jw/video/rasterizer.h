@@ -0,0 +1,189 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <algorithm>
+#include <vector>
+#include <jw/video/pixel.h>
+#include <jw/video/rect.h>
+#include <jw/matrix.h>
+
+namespace jw
+{
+    namespace video
+    {
+        // Drawing primitives for matrix<P>, where P is any pixel<> type (or px8, for fills and lines).
+        // Everything is clipped to the matrix bounds. Rectangles have an exclusive bottom-right corner.
+        // Blits between different formats go row by row through pixel::convert_span() and blend_span().
+
+        namespace detail
+        {
+            template<typename T> constexpr rect bounds(const matrix<T>& m) noexcept { return { { 0, 0 }, m.size() }; }
+            template<typename T> constexpr T* row_ptr(matrix<T>& m, std::ptrdiff_t x, std::ptrdiff_t y) noexcept { return m.data() + y * m.width() + x; }
+            template<typename T> constexpr const T* row_ptr(const matrix<T>& m, std::ptrdiff_t x, std::ptrdiff_t y) noexcept { return m.data() + y * m.width() + x; }
+
+            // Clip a blit of src_rect to pos. Returns the source rectangle and destination position.
+            template<typename T, typename U>
+            constexpr std::pair<rect, vector2i> clip_blit(const matrix<T>& dst, vector2i pos, const matrix<U>& src, rect src_rect) noexcept
+            {
+                rect s = src_rect.clipped(bounds(src));
+                vector2i d = pos + (s.topleft - src_rect.topleft);
+                rect dr = rect { d, d + s.size() }.clipped(bounds(dst));
+                s.topleft += dr.topleft - d;
+                s.bottomright = s.topleft + dr.size();
+                return { s, dr.topleft };
+            }
+
+            template<typename P>
+            constexpr bool equal(const pixel<P>& a, const pixel<P>& b) noexcept
+            {
+                if constexpr (pixel<P>::has_alpha()) if (a.a != b.a) return false;
+                return a.b == b.b and a.g == b.g and a.r == b.r;
+            }
+        }
+
+        // Fill a horizontal span from x0 up to x1 on row y.
+        template<typename T>
+        inline void fill_span(matrix<T>& dst, std::ptrdiff_t x0, std::ptrdiff_t x1, std::ptrdiff_t y, const T& c)
+        {
+            if (y < 0 or y >= dst.height()) return;
+            x0 = std::max<std::ptrdiff_t>(x0, 0);
+            x1 = std::min<std::ptrdiff_t>(x1, dst.width());
+            if (x1 > x0) std::fill_n(detail::row_ptr(dst, x0, y), x1 - x0, c);
+        }
+
+        template<typename T>
+        inline void fill_rect(matrix<T>& dst, rect r, const T& c)
+        {
+            r = r.clipped(detail::bounds(dst));
+            if (r.empty()) return;
+            for (auto y = r.topleft[1]; y < r.bottomright[1]; ++y)
+                std::fill_n(detail::row_ptr(dst, r.topleft[0], y), r.size()[0], c);
+        }
+
+        // Draw a one pixel wide outline.
+        template<typename T>
+        inline void draw_rect(matrix<T>& dst, rect r, const T& c)
+        {
+            if (r.empty()) return;
+            const auto x0 = r.topleft[0], y0 = r.topleft[1], x1 = r.bottomright[0], y1 = r.bottomright[1];
+            fill_span(dst, x0, x1, y0, c);
+            if (y1 - 1 > y0) fill_span(dst, x0, x1, y1 - 1, c);
+            fill_rect(dst, { { x0, y0 + 1 }, { x0 + 1, y1 - 1 } }, c);
+            if (x1 - 1 > x0) fill_rect(dst, { { x1 - 1, y0 + 1 }, { x1, y1 - 1 } }, c);
+        }
+
+        // Draw a line from a to b, inclusive. Uses Bresenham's algorithm after Cohen-Sutherland clipping.
+        template<typename T>
+        inline void draw_line(matrix<T>& dst, vector2i a, vector2i b, const T& c)
+        {
+            const std::ptrdiff_t xmax = dst.width() - 1, ymax = dst.height() - 1;
+            if (xmax < 0 or ymax < 0) return;
+
+            auto outcode = [xmax, ymax](const vector2i& p)
+            {
+                return (p[0] < 0 ? 1 : 0) | (p[0] > xmax ? 2 : 0) | (p[1] < 0 ? 4 : 0) | (p[1] > ymax ? 8 : 0);
+            };
+            auto ca = outcode(a), cb = outcode(b);
+            while (ca | cb)
+            {
+                if (ca & cb) return;
+                auto& p = ca ? a : b;
+                auto& code = ca ? ca : cb;
+                const auto& q = ca ? b : a;
+                const std::int64_t dx = q[0] - p[0], dy = q[1] - p[1];
+                if (code & 1) { p[1] += -p[0] * dy / dx; p[0] = 0; }
+                else if (code & 2) { p[1] += (xmax - p[0]) * dy / dx; p[0] = xmax; }
+                else if (code & 4) { p[0] += -p[1] * dx / dy; p[1] = 0; }
+                else if (code & 8) { p[0] += (ymax - p[1]) * dx / dy; p[1] = ymax; }
+                code = outcode(p);
+            }
+
+            if (a[1] == b[1]) return fill_span(dst, std::min(a[0], b[0]), std::max(a[0], b[0]) + 1, a[1], c);
+
+            const std::ptrdiff_t dx = std::abs(b[0] - a[0]), dy = std::abs(b[1] - a[1]);
+            const std::ptrdiff_t sx = a[0] < b[0] ? 1 : -1;
+            const std::ptrdiff_t sy = a[1] < b[1] ? dst.width() : -dst.width();
+            auto* p = detail::row_ptr(dst, a[0], a[1]);
+            if (dx >= dy)
+            {
+                std::ptrdiff_t err = dx / 2;
+                for (std::ptrdiff_t i = 0; i <= dx; ++i, p += sx)
+                {
+                    *p = c;
+                    if ((err -= dy) < 0) { p += sy; err += dx; }
+                }
+            }
+            else
+            {
+                std::ptrdiff_t err = dy / 2;
+                for (std::ptrdiff_t i = 0; i <= dy; ++i, p += sy)
+                {
+                    *p = c;
+                    if ((err -= dx) < 0) { p += sx; err += dy; }
+                }
+            }
+        }
+
+        // Copy src_rect from src to pos in dst, converting pixel format if needed.
+        template<typename P, typename U>
+        inline void blit(matrix<pixel<P>>& dst, vector2i pos, const matrix<pixel<U>>& src, rect src_rect)
+        {
+            auto [s, d] = detail::clip_blit(dst, pos, src, src_rect);
+            if (s.empty()) return;
+            for (auto y = 0; y < s.size()[1]; ++y)
+                pixel<P>::convert_span(detail::row_ptr(src, s.topleft[0], s.topleft[1] + y), detail::row_ptr(dst, d[0], d[1] + y), s.size()[0]);
+        }
+
+        template<typename P, typename U>
+        inline void blit(matrix<pixel<P>>& dst, vector2i pos, const matrix<pixel<U>>& src) { blit(dst, pos, src, detail::bounds(src)); }
+
+        // Alpha-blend src_rect from src onto dst. Source alpha must be premultiplied.
+        template<typename P, typename U>
+        inline void blend_blit(matrix<pixel<P>>& dst, vector2i pos, const matrix<pixel<U>>& src, rect src_rect)
+        {
+            auto [s, d] = detail::clip_blit(dst, pos, src, src_rect);
+            if (s.empty()) return;
+            for (auto y = 0; y < s.size()[1]; ++y)
+                pixel<P>::blend_span(detail::row_ptr(dst, d[0], d[1] + y), detail::row_ptr(src, s.topleft[0], s.topleft[1] + y), s.size()[0]);
+        }
+
+        template<typename P, typename U>
+        inline void blend_blit(matrix<pixel<P>>& dst, vector2i pos, const matrix<pixel<U>>& src) { blend_blit(dst, pos, src, detail::bounds(src)); }
+
+        // Copy src_rect from src to dst, skipping pixels equal to key.
+        template<typename P, typename U>
+        inline void keyed_blit(matrix<pixel<P>>& dst, vector2i pos, const matrix<pixel<U>>& src, rect src_rect, const pixel<U>& key)
+        {
+            auto [s, d] = detail::clip_blit(dst, pos, src, src_rect);
+            if (s.empty()) return;
+            const auto w = s.size()[0];
+            for (auto y = 0; y < s.size()[1]; ++y)
+            {
+                const auto* in = detail::row_ptr(src, s.topleft[0], s.topleft[1] + y);
+                auto* out = detail::row_ptr(dst, d[0], d[1] + y);
+                for (std::ptrdiff_t x = 0; x < w;)
+                {
+                    while (x < w and detail::equal(in[x], key)) ++x;
+                    auto x0 = x;
+                    while (x < w and not detail::equal(in[x], key)) ++x;
+                    if (x > x0) pixel<P>::convert_span(in + x0, out + x0, x - x0);
+                }
+            }
+        }
+
+        template<typename P, typename U>
+        inline void keyed_blit(matrix<pixel<P>>& dst, vector2i pos, const matrix<pixel<U>>& src, const pixel<U>& key) { keyed_blit(dst, pos, src, detail::bounds(src), key); }
+
+        // Alpha-blend a solid colour (with premultiplied alpha) over a rectangle.
+        template<typename P, typename U>
+        inline void blend_rect(matrix<pixel<P>>& dst, rect r, const pixel<U>& c)
+        {
+            r = r.clipped(detail::bounds(dst));
+            if (r.empty()) return;
+            std::vector<pixel<U>> row(r.size()[0], c);
+            for (auto y = r.topleft[1]; y < r.bottomright[1]; ++y)
+                pixel<P>::blend_span(detail::row_ptr(dst, r.topleft[0], y), row.data(), row.size());
+        }
+    }
+}
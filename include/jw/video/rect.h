@@ -0,0 +1,34 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <algorithm>
+#include <jw/vector.h>
+
+namespace jw
+{
+    namespace video
+    {
+        // Rectangle with exclusive bottom-right corner.
+        struct rect
+        {
+            vector2i topleft, bottomright;
+
+            constexpr vector2i size() const noexcept { return bottomright - topleft; }
+            constexpr std::ptrdiff_t area() const noexcept { return empty() ? 0 : size()[0] * size()[1]; }
+            constexpr bool empty() const noexcept { return bottomright[0] <= topleft[0] or bottomright[1] <= topleft[1]; }
+            constexpr rect merged(const rect& o) const noexcept { return { min(topleft, o.topleft), max(bottomright, o.bottomright) }; }
+            constexpr rect clipped(const rect& o) const noexcept { return { max(topleft, o.topleft), min(bottomright, o.bottomright) }; }
+            constexpr rect translated(const vector2i& v) const noexcept { return { topleft + v, bottomright + v }; }
+
+        private:
+            // vector::min() and max() compare absolute values, these don't.
+            static constexpr vector2i min(const vector2i& a, const vector2i& b) noexcept { return { std::min(a[0], b[0]), std::min(a[1], b[1]) }; }
+            static constexpr vector2i max(const vector2i& a, const vector2i& b) noexcept { return { std::max(a[0], b[0]), std::max(a[1], b[1]) }; }
+        };
+
+        // framebuffer::mark_dirty() relies on this to keep present() inside the buffer.
+        static_assert(rect { { -5, -7 }, { 3, 20 } }.clipped({ { 0, 0 }, { 10, 10 } }).topleft == vector2i { 0, 0 });
+        static_assert(rect { { -5, -7 }, { 3, 20 } }.clipped({ { 0, 0 }, { 10, 10 } }).bottomright == vector2i { 3, 10 });
+    }
+}
@@ -0,0 +1,112 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <deque>
+#include <jw/video/framebuffer.h>
+#include <jw/thread/thread.h>
+
+namespace jw
+{
+    namespace video
+    {
+        struct swap_chain_stats
+        {
+            std::size_t flips { 0 };            // number of flips queued
+            std::size_t stalls { 0 };           // frames that had to wait for the previous flip to complete
+            std::size_t queue_depth { 0 };      // flips currently pending (0 or 1)
+            chrono::tsc::duration wait_time { };    // total time spent waiting for flips
+        };
+
+        // Page-flipped swap chain in the linear framebuffer.
+        // Each present() copies the dirty regions of the back buffer to the next video page, and queues a flip
+        // to that page with vbe::schedule_display_start(). Waiting for a flip never blocks in the BIOS:
+        // the flip status is polled, and other threads run in between.
+        // With three or more pages, rendering continues while a flip is pending. With two pages, present()
+        // waits until the previous flip completes before writing.
+        // Without VBE3 hardware triple buffering, flips take effect immediately and may tear.
+        template<typename P>
+        struct swap_chain
+        {
+            swap_chain(vbe& vbe_interface, std::size_t num_pages = 3, std::size_t max_dirty_rects = 16)
+                : v(vbe_interface), fb(v, max_dirty_rects)
+            {
+                if (not v.get_mode().use_lfb_mode) throw vbe::invalid_in_current_video_mode { "Swap chain requires an LFB mode." };
+                pages = std::max<std::size_t>(std::min<std::size_t>(num_pages, v.get_mode_info()->linear_num_image_pages + 1), 1);
+                for (std::size_t i = 1; i < pages; ++i) history.emplace_back(1, rect { { 0, 0 }, fb.buffer().size() });
+                v.set_display_start({ 0, 0 });
+            }
+
+            ~swap_chain() { if (pages > 1) wait(); }
+
+            matrix<P>& buffer() noexcept { return fb.buffer(); }
+            void mark_dirty(rect r) { fb.mark_dirty(r); }
+            void mark_dirty(vector2i pos, vector2i size) { fb.mark_dirty(pos, size); }
+            void mark_all_dirty() { fb.mark_all_dirty(); }
+
+            // Copy the back buffer to the next page, and queue a flip to it.
+            void present()
+            {
+                if (pages < 2)
+                {
+                    fb.present();
+                    return;
+                }
+
+                flip_pending();
+                back = (displayed + 1 + stats.queue_depth) % pages;
+                if (pages == 2) wait();
+
+                // Each page also needs the regions that changed since it was last written.
+                auto current = fb.get_dirty();
+                for (auto& h : history)
+                    for (auto& r : h) fb.mark_dirty(r);
+                history.pop_front();
+                history.push_back(std::move(current));
+
+                fb.set_page(back);
+                fb.present();
+
+                wait();
+                v.schedule_display_start({ 0, static_cast<std::int32_t>(back * fb.buffer().height()) });
+                queued = back;
+                stats.queue_depth = 1;
+                ++stats.flips;
+            }
+
+            // Wait for the pending flip to complete, yielding to other threads.
+            void wait()
+            {
+                if (not flip_pending()) return;
+                ++stats.stalls;
+                auto t0 = chrono::tsc::now();
+                thread::yield_while([this] { return flip_pending(); });
+                stats.wait_time += chrono::tsc::now() - t0;
+            }
+
+            // Returns true if a queued flip has not taken effect yet. Does not block.
+            bool flip_pending()
+            {
+                if (stats.queue_depth == 0) return false;
+                if (not v.get_scheduled_display_start_status()) return true;
+                displayed = queued;
+                stats.queue_depth = 0;
+                return false;
+            }
+
+            const swap_chain_stats& get_stats() const noexcept { return stats; }
+            const present_stats& get_present_stats() const noexcept { return fb.get_stats(); }
+            std::size_t num_pages() const noexcept { return pages; }
+
+        private:
+            vbe& v;
+            framebuffer<P> fb;
+            std::size_t pages;
+            std::size_t displayed { 0 };
+            std::size_t queued { 0 };
+            std::size_t back { 0 };
+            std::deque<std::vector<rect>> history { };     // dirty regions of the last (pages - 1) frames
+            swap_chain_stats stats { };
+        };
+    }
+}
@@ -0,0 +1,121 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <array>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <streambuf>
+#include <ostream>
+#include <string_view>
+#include <jw/video/pixel.h>
+#include <jw/io/ioport.h>
+#include <jw/dpmi/memory.h>
+#include <jw/chrono/chrono.h>
+#include <jw/matrix.h>
+#include <jw/vector.h>
+
+namespace jw
+{
+    namespace video
+    {
+        struct text_console;
+
+        struct text_console_stats
+        {
+            std::size_t cells { 0 };            // cells written to video memory
+            std::size_t runs { 0 };             // number of contiguous runs written
+            chrono::tsc::duration time { };     // time spent in update()
+            std::size_t frames { 0 };           // total number of calls to update()
+        };
+
+        namespace detail
+        {
+            struct text_console_streambuf : public std::streambuf
+            {
+                text_console_streambuf(text_console& c) : con(c) { setp(buffer.begin(), buffer.end()); }
+
+            protected:
+                virtual int sync() override;
+                virtual std::streamsize xsputn(const char_type* s, std::streamsize n) override;
+                virtual int_type overflow(int_type c = traits_type::eof()) override;
+
+            private:
+                void flush_buffer();
+
+                std::array<char_type, 256> buffer;
+                text_console& con;
+            };
+        }
+
+        // Text-mode console that writes directly to video memory at B800h (or B000h on monochrome adapters).
+        // All output goes to a shadow buffer in system memory. update() compares it against the last known
+        // screen contents, and only copies the cells that changed, in word-sized runs.
+        // The hardware cursor is moved through the CRTC registers.
+        struct text_console
+        {
+            text_console();
+            ~text_console();
+
+            text_console(const text_console&) = delete;
+            text_console(text_console&&) = delete;
+            text_console& operator=(const text_console&) = delete;
+            text_console& operator=(text_console&&) = delete;
+
+            // The shadow buffer. Changes become visible on the next update().
+            matrix<text_char>& buffer() noexcept { return shadow; }
+            const matrix<text_char>& buffer() const noexcept { return shadow; }
+            vector2i size() const noexcept { return shadow.size(); }
+
+            // Write text at the cursor position, with the current attribute. Handles '\n', '\r', '\t' and '\b',
+            // and scrolls up when the cursor moves past the last row.
+            void put(char c);
+            void write(std::string_view str) { for (auto c : str) put(c); }
+
+            void clear();
+            void scroll(std::size_t lines = 1);
+
+            void set_attr(text_attr a) noexcept { attr = a; }
+            text_attr get_attr() const noexcept { return attr; }
+            void set_cursor(vector2i pos) noexcept
+            {
+                cursor = { std::clamp<std::int32_t>(pos[0], 0, shadow.width() - 1), std::clamp<std::int32_t>(pos[1], 0, shadow.height() - 1) };
+            }
+            vector2i get_cursor() const noexcept { return cursor; }
+            void show_cursor(bool visible);
+
+            // Copy all changed cells to video memory, and move the hardware cursor.
+            void update();
+
+            // Copy the whole shadow buffer to video memory, for when the screen was modified by other means.
+            void redraw();
+
+            void redirect_cout();
+            void restore_cout();
+
+            // Statistics from the last call to update().
+            const text_console_stats& get_stats() const noexcept { return stats; }
+
+        private:
+            static constexpr std::size_t max_gap { 4 };    // unchanged cells between two runs that are still written as one
+
+            template<typename T> T& bda(std::size_t offset) noexcept { return *reinterpret_cast<T*>(bios_data_area->get_ptr() + offset); }
+            vector2i bda_size() noexcept { return { bda<std::uint16_t>(0x4a), bda<byte>(0x84) == 0 ? 25 : bda<byte>(0x84) + 1 }; }
+            void update_cursor();
+
+            std::unique_ptr<dpmi::mapped_dos_memory<byte>> bios_data_area;
+            io::out_port<byte> crtc_index;
+            io::io_port<byte> crtc_data;
+            matrix_container<text_char> shadow;
+            std::vector<text_char> last;        // what is currently in video memory
+            std::unique_ptr<dpmi::mapped_dos_memory<text_char>> screen;
+            vector2i cursor { 0, 0 };
+            vector2i hw_cursor { -1, -1 };
+            text_attr attr { };
+            std::unique_ptr<detail::text_console_streambuf> streambuf;
+            std::streambuf* cout { nullptr };
+            text_console_stats stats { };
+        };
+    }
+}
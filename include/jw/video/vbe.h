@@ -36,6 +36,10 @@ namespace jw
             virtual bool get_scheduled_display_start_status();
             virtual std::uint8_t set_palette_format(std::uint8_t bits_per_channel);
             virtual std::uint8_t get_palette_format();
+            virtual void set_window(std::size_t position, bool window_b = false);
+
+            const vbe_mode_info* get_mode_info() const noexcept { return mode_info; }
+            vbe_mode get_mode() const noexcept { return mode; }
 
             std::size_t get_bits_per_pixel()
             {
@@ -54,11 +58,14 @@ namespace jw
         protected:
             void check_error(split_uint16_t ax, const char* function_name);
             void populate_mode_list(dpmi::far_ptr16 list_ptr);
+            bool vga_compatible() const noexcept { return not info.capabilities.is_not_vga_compatible and (mode_info == nullptr or not mode_info->attr.is_not_vga_compatible); }
 
             vbe_info info;
             std::map<std::uint_fast16_t, vbe_mode_info> modes { };
             vbe_mode mode;
             vbe_mode_info* mode_info { nullptr };
+            std::tuple<std::size_t, std::size_t, std::size_t> scanline { };    // cached by get/set_scanline_length()
+            bool scanline_valid { false };
         };
 
         struct vbe2 : public vbe
@@ -68,6 +75,7 @@ namespace jw
             virtual void set_display_start(vector2i pos, bool wait_for_vsync = false) override;
             virtual void set_palette(const px32n* begin, const px32n* end, std::size_t first = 0, bool wait_for_vsync = false) override;
             virtual std::vector<px32n> get_palette() override;
+            virtual void set_window(std::size_t position, bool window_b = false) override;
         };
 
         struct vbe3 : public vbe2
@@ -78,17 +86,20 @@ namespace jw
             //virtual vbe_mode get_current_mode()
             //virtual save_state()
             //virtual restore_state()
-            //virtual std::uint32_t set_window()
+            virtual void set_window(std::size_t position, bool window_b = false) override;
             //virtual std::uint32_t get_window()
             virtual std::tuple<std::size_t, std::size_t, std::size_t> set_scanline_length(std::size_t width, bool width_in_pixels = true) override;
             virtual std::tuple<std::size_t, std::size_t, std::size_t> get_max_scanline_length() override;
+            virtual std::tuple<std::size_t, std::size_t, std::size_t> get_scanline_length() override;
             virtual void set_display_start(vector2i pos, bool wait_for_vsync = false) override;
+            virtual vector2i get_display_start() override;
             virtual void schedule_display_start(vector2i pos) override;
             //virtual void schedule_stereo_display_start(bool wait_for_vsync = false)
             virtual bool get_scheduled_display_start_status() override;
             //virtual void enable_stereo()
             //virtual void disable_stereo()
             virtual std::uint8_t set_palette_format(std::uint8_t bits_per_channel) override;
+            virtual std::uint8_t get_palette_format() override;
             virtual void set_palette(const px32n* begin, const px32n* end, std::size_t first = 0, bool wait_for_vsync = false) override;
             virtual std::uint32_t get_closest_pixel_clock(std::uint32_t desired_clock, std::uint16_t mode_num);
         };
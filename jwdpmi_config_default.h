@@ -35,6 +35,9 @@ namespace jw
         // Default stack size for threads.
         constexpr std::size_t thread_default_stack_size = 64_KB;
 
+        // Size of the conventional memory buffer used for transfers to and from real-mode code. Maximum is 0xfff0.
+        constexpr std::size_t transfer_buffer_size = 32_KB;
+
         // Set up cpu exception handlers to throw C++ exceptions instead.
         constexpr bool enable_throwing_from_cpu_exceptions = true;
 
@@ -47,6 +50,12 @@ namespace jw
         // Display raw packet data from serial gdb interface
         constexpr bool enable_gdb_protocol_dump = false;
 
+        // Enable trace points for debug::trace_write_json(). When disabled, trace points compile to nothing.
+        constexpr bool enable_trace = false;
+
+        // Number of events stored in the trace buffer. Must be a power of two.
+        constexpr std::size_t trace_buffer_size = 4096;
+
         // Enable this to work around buggy keyboard code in dosbox.
         constexpr bool dosbox = false;
 
@@ -6,6 +6,7 @@
 #include <jw/dpmi/cpu_exception.h>
 #include <jw/debug/debug.h>
 #include <jw/dpmi/detail/interrupt_id.h>
+#include <jw/debug/trace.h>
 #include <cstring>
 #include <vector>
 
@@ -38,11 +39,13 @@ namespace jw
                 ++detail::exception_count;
                 auto fpu_context_switch_handled = detail::fpu_context_switcher.enter(exc);
                 detail::interrupt_id::push_back(exc, detail::interrupt_id::id_t::exception);
+                debug::trace_begin("exception");
                 return fpu_context_switch_handled;
             }
 
             void leave_exception_context() noexcept
             {
+                debug::trace_end("exception");
                 detail::interrupt_id::pop_back();
                 detail::fpu_context_switcher.leave();
                 --detail::exception_count;
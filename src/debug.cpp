@@ -11,6 +11,9 @@
 #include <cstdlib>
 #include <string_view>
 #include <set>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
 #include <unwind.h>
 #include <jw/dpmi/fpu.h>
 #include <jw/dpmi/dpmi.h>
@@ -57,7 +60,18 @@ namespace jw
             locked_pool_allocator<> alloc { 1_MB };
             std::map<std::string, std::string, std::less<std::string>, locked_pool_allocator<>> supported { alloc };
             std::map<std::uintptr_t, watchpoint, std::less<std::uintptr_t>, locked_pool_allocator<>> watchpoints { alloc };
-            std::map<std::uintptr_t, byte, std::less<std::uintptr_t>, locked_pool_allocator<>> breakpoints { alloc };
+
+            struct breakpoint_info
+            {
+                byte saved_byte;
+                bool inserted { false };
+                std::vector<byte, locked_pool_allocator<>> conditions { alloc };   // agent expressions, each preceded by its length
+
+                breakpoint_info(byte b) : saved_byte(b) { }
+            };
+            std::unordered_map<std::uintptr_t, breakpoint_info, std::hash<std::uintptr_t>, std::equal_to<std::uintptr_t>, locked_pool_allocator<>> breakpoints { alloc };
+            std::uintptr_t stepping_over { 0 };     // breakpoint removed to resume execution on it
+            bool silent_step { false };             // true if stepping only to reinsert this breakpoint
             std::map<int, void(*)(int)> signal_handlers {  };
 
             std::array<std::unique_ptr<exception_handler>, 0x20> exception_handlers;
@@ -370,40 +384,244 @@ namespace jw
                 return true;
             }
 
-            inline void set_breakpoint(std::uintptr_t at)
+            breakpoint_info* find_breakpoint(std::uintptr_t at)
             {
-                auto* ptr = reinterpret_cast<byte*>(at);
-                if (breakpoints.count(at) == 0) breakpoints[at] = *ptr;
-                *ptr = 0xcc;
+                auto i = breakpoints.find(at);
+                if (i == breakpoints.end()) return nullptr;
+                return &i->second;
+            }
+
+            inline void insert_breakpoint(std::uintptr_t at, breakpoint_info& bp)
+            {
+                if (bp.inserted) return;
+                *reinterpret_cast<byte*>(at) = 0xcc;
+                bp.inserted = true;
+            }
+
+            inline void remove_breakpoint(std::uintptr_t at, breakpoint_info& bp)
+            {
+                if (not bp.inserted) return;
+                *reinterpret_cast<byte*>(at) = bp.saved_byte;
+                bp.inserted = false;
+            }
+
+            inline breakpoint_info& set_breakpoint(std::uintptr_t at)
+            {
+                auto* bp = find_breakpoint(at);
+                if (bp == nullptr) bp = &breakpoints.emplace(at, breakpoint_info { *reinterpret_cast<byte*>(at) }).first->second;
+                if (at != stepping_over) insert_breakpoint(at, *bp);
+                return *bp;
             }
 
             inline bool clear_breakpoint(std::uintptr_t at)
             {
-                auto* ptr = reinterpret_cast<byte*>(at);
-                if (breakpoints.count(at) > 0)
+                auto* bp = find_breakpoint(at);
+                if (bp == nullptr) return false;
+                remove_breakpoint(at, *bp);
+                breakpoints.erase(at);
+                if (stepping_over == at) stepping_over = 0;
+                return true;
+            }
+
+            // Reinsert the breakpoint we last stepped over.
+            inline void reinsert_breakpoint()
+            {
+                if (stepping_over == 0) return;
+                if (auto* bp = find_breakpoint(stepping_over)) insert_breakpoint(stepping_over, *bp);
+                stepping_over = 0;
+                silent_step = false;
+            }
+
+            // Prepare to resume execution. If we're about to resume on a breakpoint, only that one is removed,
+            // and the trap flag is set so it can be reinserted after one instruction.
+            inline void step_over_breakpoint(exception_frame* f)
+            {
+                auto at = f->fault_address.offset;
+                if (stepping_over != at) reinsert_breakpoint();
+                if (auto* bp = find_breakpoint(at))
                 {
-                    *ptr = breakpoints[at];
-                    breakpoints.erase(at);
-                    return true;
+                    remove_breakpoint(at, *bp);
+                    stepping_over = at;
+                    silent_step = not f->flags.trap;    // trap only to reinsert, don't report it
+                    f->flags.trap = true;
                 }
-                else return false;
+                else if (*reinterpret_cast<byte*>(at) == 0xcc) f->fault_address.offset += 1;  // hardcoded breakpoint, safe to skip
             }
 
-            inline bool disable_breakpoint(std::uintptr_t at)
+            // Update the saved bytes of breakpoints overwritten by gdb.
+            inline void rewrite_breakpoints(std::uintptr_t begin, std::size_t len)
             {
-                auto* ptr = reinterpret_cast<byte*>(at);
-                if (breakpoints.count(at) > 0)
+                for (auto at = begin; at < begin + len; ++at)
                 {
-                    *ptr = breakpoints[at];
-                    return true;
+                    if (auto* bp = find_breakpoint(at))
+                    {
+                        bp->saved_byte = *reinterpret_cast<byte*>(at);
+                        bp->inserted = false;
+                        if (at != stepping_over) insert_breakpoint(at, *bp);
+                    }
+                }
+            }
+
+            inline bool any_watchpoint_triggered()
+            {
+                for (auto&& w : watchpoints)
+                    if (w.second.get_state()) return true;
+                return false;
+            }
+
+            // Agent expression bytecodes, found in {gdb source}/gdb/common/ax.def
+            enum agent_op : byte
+            {
+                op_add = 0x02, op_sub, op_mul, op_div_signed, op_div_unsigned, op_rem_signed, op_rem_unsigned,
+                op_lsh, op_rsh_signed, op_rsh_unsigned, op_trace, op_trace_quick, op_log_not,
+                op_bit_and, op_bit_or, op_bit_xor, op_bit_not, op_equal, op_less_signed, op_less_unsigned,
+                op_ext, op_ref8, op_ref16, op_ref32, op_ref64,
+                op_if_goto = 0x20, op_goto, op_const8, op_const16, op_const32, op_const64, op_reg, op_end,
+                op_dup, op_pop, op_zero_ext, op_swap,
+                op_pick = 0x32, op_rot
+            };
+
+            std::uint32_t agent_reg(regnum n, const cpu_registers* r, const exception_frame* f)
+            {
+                auto* nf = static_cast<const new_exception_frame*>(f);
+                switch (n)
+                {
+                case eax: return r->eax;
+                case ecx: return r->ecx;
+                case edx: return r->edx;
+                case ebx: return r->ebx;
+                case esp: return f->stack.offset;
+                case ebp: return r->ebp;
+                case esi: return r->esi;
+                case edi: return r->edi;
+                case eip: return f->fault_address.offset;
+                case eflags: return f->flags.raw_eflags;
+                case cs: return f->fault_address.segment;
+                case ss: return f->stack.segment;
+                case ds: if (new_frame_type) return nf->ds; break;
+                case es: if (new_frame_type) return nf->es; break;
+                case fs: if (new_frame_type) return nf->fs; break;
+                case gs: if (new_frame_type) return nf->gs; break;
+                default: break;
+                }
+                throw std::invalid_argument { "agent expression: register not available" };
+            }
+
+            // Evaluate an agent expression. Tracing, floating-point and variable bytecodes are not supported.
+            std::int64_t eval_agent_expression(const byte* code, std::size_t size, const cpu_registers* r, const exception_frame* f)
+            {
+                std::array<std::uint64_t, 32> stack;
+                std::size_t sp { 0 };
+                std::size_t pc { 0 };
+
+                auto push = [&](std::uint64_t v)
+                {
+                    if (sp >= stack.size()) throw std::out_of_range { "agent expression: stack overflow" };
+                    stack[sp++] = v;
+                };
+                auto pop = [&]
+                {
+                    if (sp == 0) throw std::out_of_range { "agent expression: stack underflow" };
+                    return stack[--sp];
+                };
+                auto operand = [&](std::size_t n)
+                {
+                    if (pc + n > size) throw std::out_of_range { "agent expression: truncated" };
+                    std::uint64_t v { 0 };
+                    for (std::size_t i = 0; i < n; ++i) v = (v << 8) | code[pc++];
+                    return v;
+                };
+                auto sign_extend = [](std::uint64_t v, std::size_t bits) -> std::uint64_t
+                {
+                    if (bits == 0) return 0;
+                    if (bits >= 64) return v;
+                    auto shift = 64 - bits;
+                    return static_cast<std::int64_t>(v << shift) >> shift;
+                };
+
+                while (pc < size)
+                {
+                    std::uint64_t a, b;
+                    switch (code[pc++])
+                    {
+                    case op_add: b = pop(); a = pop(); push(a + b); break;
+                    case op_sub: b = pop(); a = pop(); push(a - b); break;
+                    case op_mul: b = pop(); a = pop(); push(a * b); break;
+                    case op_div_signed:
+                    case op_rem_signed:
+                        b = pop(); a = pop();
+                        if (b == 0) throw std::domain_error { "agent expression: division by zero" };
+                        if (code[pc - 1] == op_div_signed) push(static_cast<std::int64_t>(a) / static_cast<std::int64_t>(b));
+                        else push(static_cast<std::int64_t>(a) % static_cast<std::int64_t>(b));
+                        break;
+                    case op_div_unsigned:
+                    case op_rem_unsigned:
+                        b = pop(); a = pop();
+                        if (b == 0) throw std::domain_error { "agent expression: division by zero" };
+                        if (code[pc - 1] == op_div_unsigned) push(a / b);
+                        else push(a % b);
+                        break;
+                    case op_lsh: b = pop(); a = pop(); push(b >= 64 ? 0 : a << b); break;
+                    case op_rsh_signed: b = pop(); a = pop(); push(static_cast<std::int64_t>(a) >> std::min<std::uint64_t>(b, 63)); break;
+                    case op_rsh_unsigned: b = pop(); a = pop(); push(b >= 64 ? 0 : a >> b); break;
+                    case op_log_not: push(pop() == 0); break;
+                    case op_bit_and: b = pop(); a = pop(); push(a & b); break;
+                    case op_bit_or: b = pop(); a = pop(); push(a | b); break;
+                    case op_bit_xor: b = pop(); a = pop(); push(a ^ b); break;
+                    case op_bit_not: push(~pop()); break;
+                    case op_equal: b = pop(); a = pop(); push(a == b); break;
+                    case op_less_signed: b = pop(); a = pop(); push(static_cast<std::int64_t>(a) < static_cast<std::int64_t>(b)); break;
+                    case op_less_unsigned: b = pop(); a = pop(); push(a < b); break;
+                    case op_ext: b = operand(1); push(sign_extend(pop(), b)); break;
+                    case op_zero_ext: b = operand(1); a = pop(); push(b >= 64 ? a : a & ((1ull << b) - 1)); break;
+                    case op_ref8:  push(*reinterpret_cast<const volatile std::uint8_t*>(pop())); break;
+                    case op_ref16: push(*reinterpret_cast<const volatile std::uint16_t*>(pop())); break;
+                    case op_ref32: push(*reinterpret_cast<const volatile std::uint32_t*>(pop())); break;
+                    case op_ref64: push(*reinterpret_cast<const volatile std::uint64_t*>(pop())); break;
+                    case op_if_goto: b = operand(2); if (pop() != 0) pc = b; break;
+                    case op_goto: pc = operand(2); break;
+                    case op_const8: push(operand(1)); break;
+                    case op_const16: push(operand(2)); break;
+                    case op_const32: push(operand(4)); break;
+                    case op_const64: push(operand(8)); break;
+                    case op_reg: push(agent_reg(static_cast<regnum>(operand(2)), r, f)); break;
+                    case op_end: return sp > 0 ? pop() : 0;
+                    case op_dup: a = pop(); push(a); push(a); break;
+                    case op_pop: pop(); break;
+                    case op_swap: b = pop(); a = pop(); push(b); push(a); break;
+                    case op_pick:
+                        b = operand(1);
+                        if (b >= sp) throw std::out_of_range { "agent expression: stack underflow" };
+                        push(stack[sp - 1 - b]);
+                        break;
+                    case op_rot:
+                        if (sp < 3) throw std::out_of_range { "agent expression: stack underflow" };
+                        std::rotate(stack.begin() + sp - 3, stack.begin() + sp - 1, stack.begin() + sp);
+                        break;
+                    default: throw std::invalid_argument { "agent expression: unsupported bytecode" };
+                    }
                 }
-                else return false;
+                throw std::out_of_range { "agent expression: no end" };
             }
 
-            inline void enable_all_breakpoints()
+            // Returns true if the breakpoint has no conditions, or if any of its conditions are true.
+            bool breakpoint_condition(const breakpoint_info& bp, const cpu_registers* r, const exception_frame* f)
             {
-                for (auto&& bp : breakpoints)
-                    *reinterpret_cast<byte*>(bp.first) = 0xcc;
+                if (bp.conditions.empty()) return true;
+                debugger_reentry = true;    // faults throw instead of entering the debugger
+                bool result { false };
+                try
+                {
+                    for (auto i = bp.conditions.begin(); i < bp.conditions.end() and not result;)
+                    {
+                        std::size_t len = i[0] | (i[1] << 8);
+                        result = eval_agent_expression(&i[2], len, r, f) != 0;
+                        i += 2 + len;
+                    }
+                }
+                catch (...) { result = true; }  // let gdb figure it out
+                debugger_reentry = false;
+                return result;
             }
 
             // Decode big-endian hex string
@@ -840,7 +1058,7 @@ namespace jw
                                 supported[str.substr(0, equals_sign).data()] = str.substr(equals_sign + 1);
                             }
                         }
-                        send_packet("PacketSize=399;swbreak+;hwbreak+;QThreadEvents+;no-resumed+");
+                        send_packet("PacketSize=399;swbreak+;hwbreak+;QThreadEvents+;no-resumed+;ConditionalBreakpoints+");
                     }
                     else if (q == "Attached") send_packet("0");
                     else if (q == "C")
@@ -1033,7 +1251,11 @@ namespace jw
                 {
                     auto* addr = reinterpret_cast<byte*>(decode(packet[0]));
                     std::size_t len = decode(packet[1]);
-                    if (reverse_decode(packet[2], addr, len)) send_packet("OK");
+                    if (reverse_decode(packet[2], addr, len))
+                    {
+                        rewrite_breakpoints(reinterpret_cast<std::uintptr_t>(addr), len);
+                        send_packet("OK");
+                    }
                     else send_packet("E00");
                 }
                 else if (p == 'c' or p == 's')  // step/continue
@@ -1078,13 +1300,34 @@ namespace jw
                     auto ptr = reinterpret_cast<byte*>(addr);
                     if (z == '0')   // set breakpoint
                     {
-                        if (packet.size() > 3)  // conditional breakpoint
+                        try
                         {
-                            send_packet("");    // not implemented (TODO)
-                            return;
+                            std::vector<byte, locked_pool_allocator<>> conditions { alloc };
+                            for (std::size_t i = 3; i < packet.size() and packet[i].delim == ';' and not packet[i].empty() and packet[i][0] == 'X'; ++i)
+                            {   // conditional breakpoint: X<len>,<bytecode>, gdb may concatenate several in one field
+                                std::string_view head = packet[i];
+                                while (not head.empty())
+                                {
+                                    if (head[0] != 'X' or i + 1 >= packet.size() or packet[i + 1].delim != ',') throw std::invalid_argument { "bad condition" };
+                                    std::size_t len = decode(head.substr(1));
+                                    std::string_view code = packet[++i];
+                                    if (code.size() < 2 * len) throw std::invalid_argument { "bad condition" };
+                                    auto at = conditions.size();
+                                    conditions.resize(at + 2 + len);
+                                    conditions[at] = len & 0xff;
+                                    conditions[at + 1] = len >> 8;
+                                    if (not reverse_decode(code.substr(0, 2 * len), &conditions[at + 2], len)) throw std::invalid_argument { "bad condition" };
+                                    head = code.substr(2 * len);
+                                }
+                            }
+                            auto& bp = set_breakpoint(addr);
+                            bp.conditions = std::move(conditions);
+                            send_packet("OK");
+                        }
+                        catch (...)
+                        {
+                            send_packet("E00");
                         }
-                        set_breakpoint(addr);
-                        send_packet("OK");
                     }
                     else            // set watchpoint
                     {
@@ -1163,13 +1406,7 @@ namespace jw
                 auto leave = [exc, f]
                 {
                     for (auto&& w : watchpoints) w.second.reset();
-                    enable_all_breakpoints();
-                    if (*reinterpret_cast<byte*>(f->fault_address.offset) == 0xcc)  // don't resume on a breakpoint
-                    {
-                        if (disable_breakpoint(f->fault_address.offset))
-                            f->flags.trap = true;   // trap on next instruction to re-enable
-                        else f->fault_address.offset += 1;  // hardcoded breakpoint, safe to skip
-                    }
+                    step_over_breakpoint(f);    // don't resume on a breakpoint
 
                     if (debugmsg) std::clog << "leaving exception 0x" << std::hex << exc << ", resuming at 0x" << f->fault_address.offset << '\n';
                 };
@@ -1198,12 +1435,30 @@ namespace jw
                         if (debugmsg) std::clog << "reentry caused by breakpoint, ignoring.\n";
                         leave();
                         f->flags.trap = false;
+                        silent_step = false;
                         return true;
                     }
                     if (debugmsg) std::clog << "debugger re-entry! " << *static_cast<new_exception_frame*>(f) << *r;
                     throw cpu_exception { exc, r, f, new_frame_type };
                 }
 
+                if (exc == exception_num::trap and silent_step and not any_watchpoint_triggered())
+                {   // stepped over a breakpoint, reinsert it and continue
+                    reinsert_breakpoint();
+                    f->flags.trap = false;
+                    return true;
+                }
+
+                if (exc == exception_num::breakpoint and current_signal == -1 and not f->flags.trap and not packet_available())
+                {   // conditional breakpoint, resume immediately if false
+                    auto* bp = find_breakpoint(f->fault_address.offset);
+                    if (bp != nullptr and not breakpoint_condition(*bp, r, f))
+                    {
+                        step_over_breakpoint(f);
+                        return true;
+                    }
+                }
+
                 try
                 {
                     debugger_reentry = true;
@@ -1216,7 +1471,7 @@ namespace jw
                         current_thread->signals.insert(current_signal);
                         current_signal = -1;
                     }
-                    else if (exc == exception_num::trap and [] {for (auto&& w : watchpoints) { if (w.second.get_state()) return true; } return false; }())
+                    else if (exc == exception_num::trap and any_watchpoint_triggered())
                     {
                         current_thread->signals.insert(watchpoint_hit);
                     }
@@ -1383,7 +1638,7 @@ namespace jw
                 debug_mode = false;
                 serial_irq.reset();
                 watchpoints.clear();
-                for (auto&& bp : breakpoints) *reinterpret_cast<byte*>(bp.first) = bp.second;
+                for (auto&& bp : breakpoints) remove_breakpoint(bp.first, bp.second);
                 for (auto&& e : exception_handlers) e.reset();
                 for (auto&& s : signal_handlers) std::signal(s.first, s.second);
             }
@@ -0,0 +1,211 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#include <cstring>
+#include <jw/io/dos_file.h>
+
+namespace jw
+{
+    namespace io
+    {
+        namespace detail
+        {
+            dos_streambuf::dos_streambuf(const char* filename, std::ios::openmode mode, std::size_t buffer_size)
+                : buffer(buffer_size), owns_handle(true)
+            {
+                auto len = std::strlen(filename) + 1;
+                if (len > dpmi::transfer_buffer::size()) throw std::invalid_argument { "File name too long." };
+                std::copy_n(filename, len, dpmi::transfer_buffer::data());
+
+                dpmi::realmode_registers reg { };
+                if ((mode & std::ios::out) and (mode & std::ios::trunc or not (mode & (std::ios::in | std::ios::app))))
+                {
+                    reg.ah = 0x3c;      // create or truncate
+                    reg.cx = 0;
+                }
+                else
+                {
+                    reg.ah = 0x3d;      // open existing file
+                    reg.al = (mode & std::ios::out) ? ((mode & std::ios::in) ? 2 : 1) : 0;
+                }
+                reg.ds = dpmi::transfer_buffer::get_dos_ptr().segment;
+                reg.dx = dpmi::transfer_buffer::get_dos_ptr().offset;
+                auto open = reg;
+                reg.call_int(0x21);
+                if (reg.flags.carry and reg.ax == 0x02 and (mode & std::ios::app))
+                {   // file not found, append mode creates it
+                    reg = open;
+                    reg.ah = 0x3c;
+                    reg.cx = 0;
+                    reg.call_int(0x21);
+                }
+                if (reg.flags.carry) throw dos_error { reg.ax, "Failed to open file." };
+                handle = reg.ax;
+
+                if (mode & (std::ios::app | std::ios::ate)) seek(0, 2);
+                setg(buffer.data(), buffer.data(), buffer.data());
+                setp(nullptr, nullptr);
+            }
+
+            dos_streambuf::dos_streambuf(std::uint16_t dos_handle, std::size_t buffer_size)
+                : buffer(buffer_size), handle(dos_handle), owns_handle(false)
+            {
+                setg(buffer.data(), buffer.data(), buffer.data());
+                setp(nullptr, nullptr);
+            }
+
+            dos_streambuf::~dos_streambuf()
+            {
+                try { flush_put_area(); }
+                catch (...) { }
+                if (not owns_handle) return;
+                dpmi::realmode_registers reg { };
+                reg.ah = 0x3e;
+                reg.bx = handle;
+                reg.call_int(0x21);
+            }
+
+            // INT 21h AH=3Fh, one call per transfer buffer chunk.
+            std::size_t dos_streambuf::read(char_type* dst, std::size_t size)
+            {
+                return dpmi::transfer_buffer::read(dst, size, [this](dpmi::far_ptr16 buf, std::size_t n)
+                {
+                    dpmi::realmode_registers reg { };
+                    reg.ah = 0x3f;
+                    reg.bx = handle;
+                    reg.cx = n;
+                    reg.ds = buf.segment;
+                    reg.dx = buf.offset;
+                    reg.call_int(0x21);
+                    if (reg.flags.carry) throw dos_error { reg.ax, "Failed to read file." };
+                    return reg.ax;
+                });
+            }
+
+            // INT 21h AH=40h, one call per transfer buffer chunk.
+            std::size_t dos_streambuf::write(const char_type* src, std::size_t size)
+            {
+                auto w = dpmi::transfer_buffer::write(src, size, [this](dpmi::far_ptr16 buf, std::size_t n)
+                {
+                    dpmi::realmode_registers reg { };
+                    reg.ah = 0x40;
+                    reg.bx = handle;
+                    reg.cx = n;
+                    reg.ds = buf.segment;
+                    reg.dx = buf.offset;
+                    reg.call_int(0x21);
+                    if (reg.flags.carry) throw dos_error { reg.ax, "Failed to write file." };
+                    return reg.ax;
+                });
+                if (w < size) throw io_error { "Disk full." };
+                return w;
+            }
+
+            // INT 21h AH=42h
+            std::uint32_t dos_streambuf::seek(std::int32_t offset, byte origin)
+            {
+                split_uint32_t off { static_cast<std::uint32_t>(offset) };
+                dpmi::realmode_registers reg { };
+                reg.ah = 0x42;
+                reg.al = origin;
+                reg.bx = handle;
+                reg.cx = off.hi;
+                reg.dx = off.lo;
+                reg.call_int(0x21);
+                if (reg.flags.carry) throw dos_error { reg.ax, "Failed to seek." };
+                split_uint32_t pos { };
+                pos.lo = reg.ax;
+                pos.hi = reg.dx;
+                return pos;
+            }
+
+            void dos_streambuf::flush_put_area()
+            {
+                if (pptr() == pbase()) return;
+                write(pbase(), pptr() - pbase());
+                setp(nullptr, nullptr);
+            }
+
+            int dos_streambuf::sync()
+            {
+                try
+                {
+                    flush_put_area();
+                    if (gptr() < egptr()) seek(gptr() - egptr(), 1);    // discard read-ahead
+                    setg(buffer.data(), buffer.data(), buffer.data());
+                    return 0;
+                }
+                catch (...) { return -1; }
+            }
+
+            dos_streambuf::int_type dos_streambuf::underflow()
+            {
+                if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+                flush_put_area();
+                auto n = read(buffer.data(), buffer.size());
+                setg(buffer.data(), buffer.data(), buffer.data() + n);
+                if (n == 0) return traits_type::eof();
+                return traits_type::to_int_type(*gptr());
+            }
+
+            std::streamsize dos_streambuf::xsgetn(char_type* s, std::streamsize n)
+            {
+                std::streamsize done = std::min(n, egptr() - gptr());
+                std::copy_n(gptr(), done, s);
+                gbump(done);
+                if (done == n) return done;
+
+                flush_put_area();
+                if (static_cast<std::size_t>(n - done) >= buffer.size())    // large read, bypass our buffer
+                    return done + read(s + done, n - done);
+
+                while (done < n and underflow() != traits_type::eof())
+                {
+                    auto i = std::min(n - done, egptr() - gptr());
+                    std::copy_n(gptr(), i, s + done);
+                    gbump(i);
+                    done += i;
+                }
+                return done;
+            }
+
+            dos_streambuf::int_type dos_streambuf::overflow(int_type c)
+            {
+                if (gptr() < egptr())
+                {
+                    seek(gptr() - egptr(), 1);
+                    setg(buffer.data(), buffer.data(), buffer.data());
+                }
+                flush_put_area();
+                setp(buffer.data(), buffer.data() + buffer.size());
+                if (not traits_type::eq_int_type(c, traits_type::eof())) sputc(traits_type::to_char_type(c));
+                return traits_type::not_eof(c);
+            }
+
+            std::streamsize dos_streambuf::xsputn(const char_type* s, std::streamsize n)
+            {
+                if (static_cast<std::size_t>(n) < buffer.size()) return std::streambuf::xsputn(s, n);
+                overflow();                 // switch to put mode and flush
+                return write(s, n);         // large write, bypass our buffer
+            }
+
+            dos_streambuf::pos_type dos_streambuf::seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode)
+            {
+                try
+                {
+                    if (dir == std::ios::cur) off -= egptr() - gptr();
+                    flush_put_area();
+                    setg(buffer.data(), buffer.data(), buffer.data());
+                    byte origin = dir == std::ios::beg ? 0 : dir == std::ios::cur ? 1 : 2;
+                    return pos_type { off_type { seek(off, origin) } };
+                }
+                catch (...) { return pos_type { off_type { -1 } }; }
+            }
+
+            dos_streambuf::pos_type dos_streambuf::seekpos(pos_type pos, std::ios::openmode which)
+            {
+                return seekoff(off_type { pos }, std::ios::beg, which);
+            }
+        }
+    }
+}
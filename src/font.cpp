@@ -0,0 +1,46 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#include <stdexcept>
+#include <jw/video/font.h>
+#include <jw/dpmi/memory.h>
+#include <jw/dpmi/realmode.h>
+
+namespace jw
+{
+    namespace video
+    {
+        bitmap_font bitmap_font::vga_rom(std::size_t height)
+        {
+            auto get_table = [](byte bh)
+            {
+                dpmi::realmode_registers reg { };
+                reg.ax = 0x1130;
+                reg.bh = bh;
+                reg.call_int(0x10);
+                return dpmi::far_ptr16 { reg.es, reg.bp };
+            };
+
+            std::vector<byte> glyphs;
+            glyphs.reserve(256 * height);
+            auto copy = [&glyphs, height](dpmi::far_ptr16 p, std::size_t n)
+            {
+                dpmi::mapped_dos_memory<byte> rom { n * height, p };
+                auto* ptr = rom.get_ptr();
+                glyphs.insert(glyphs.end(), ptr, ptr + n * height);
+            };
+
+            switch (height)
+            {
+            case 8:     // the 8x8 table only holds characters 00-7F, 80-FF are in a separate table
+                copy(get_table(0x03), 128);
+                copy(get_table(0x04), 128);
+                break;
+            case 14: copy(get_table(0x02), 256); break;
+            case 16: copy(get_table(0x06), 256); break;
+            default: throw std::invalid_argument { "VGA ROM fonts are 8, 14 or 16 pixels high." };
+            }
+            return bitmap_font { 8, height, std::move(glyphs) };
+        }
+    }
+}
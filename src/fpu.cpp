@@ -6,6 +6,7 @@
 #include <jw/dpmi/cpu_exception.h>
 #include <jw/dpmi/irq.h>
 #include <jw/dpmi/irq_mask.h>
+#include <jw/debug/trace.h>
 
 namespace jw
 {
@@ -159,6 +160,7 @@ namespace jw
                             {
                                 i = alloc.allocate(1);
                                 i->save();
+                                debug::trace_event("fpu save");
                                 break;
                             }
                         }
@@ -167,6 +169,7 @@ namespace jw
                     else
                     {
                         contexts.back()->restore();
+                        debug::trace_event("fpu restore");
                         alloc.deallocate(contexts.back(), 1);
                         contexts.back() = nullptr;
                     }
@@ -0,0 +1,74 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#include <jw/video/framebuffer.h>
+
+namespace jw
+{
+    namespace video
+    {
+        namespace detail
+        {
+            framebuffer_output::framebuffer_output(vbe& vbe_interface) : v(vbe_interface)
+            {
+                const auto* info = v.get_mode_info();
+                if (info == nullptr) throw vbe::invalid_in_current_video_mode { "No VBE mode set." };
+                const auto mode = v.get_mode();
+
+                resolution = { info->resolution_x, info->resolution_y };
+                switch (info->bits_per_pixel)
+                {
+                case 8:  format = indexed8; break;
+                case 15: format = rgb555; break;
+                case 16: format = (info->green_mask_size == 5) ? rgb555 : rgb565; break;
+                case 24: format = rgb888; break;
+                case 32: format = xrgb8888; break;
+                default: throw vbe::invalid_in_current_video_mode { "Unsupported pixel format." };
+                }
+                bytes_per_pixel = (info->bits_per_pixel + 7) / 8;
+
+                if (mode.use_lfb_mode)
+                {
+                    pitch = (v.get_vbe_info().vbe_version >= 0x300) ? info->linear_bytes_per_scanline : info->bytes_per_scanline;
+                    lfb_mem = std::make_unique<dpmi::device_memory<byte>>(pitch * resolution.y() * std::max(info->linear_num_image_pages + 1, 1), info->physical_base_ptr);
+                }
+                else
+                {
+                    pitch = info->bytes_per_scanline;
+                    window_b = not info->winA_attr.is_writeable and info->winB_attr.is_writeable;
+                    granularity = info->win_granularity * 1_KB;
+                    window_size = info->win_size * 1_KB;
+                    if (granularity == 0 or window_size == 0) throw vbe::invalid_in_current_video_mode { "Invalid window size." };
+                    auto segment = window_b ? info->winB_segment : info->winA_segment;
+                    window = std::make_unique<dpmi::mapped_dos_memory<byte>>(window_size, dpmi::far_ptr16 { segment, 0 });
+                }
+            }
+
+            void framebuffer_output::write(std::size_t offset, const byte* src, std::size_t size)
+            {
+                auto* dst = window->get_ptr();
+                while (size > 0)
+                {
+                    // Use the bank that is already mapped if the offset still falls within the window.
+                    std::size_t window_offset;
+                    if (current_bank != static_cast<std::size_t>(-1) and offset >= current_bank * granularity and offset < current_bank * granularity + window_size)
+                    {
+                        window_offset = offset - current_bank * granularity;
+                    }
+                    else
+                    {
+                        current_bank = offset / granularity;
+                        v.set_window(current_bank, window_b);
+                        ++bank_switches;
+                        window_offset = offset % granularity;
+                    }
+                    auto n = std::min(size, window_size - window_offset);
+                    std::memcpy(dst + window_offset, src, n);
+                    src += n;
+                    offset += n;
+                    size -= n;
+                }
+            }
+        }
+    }
+}
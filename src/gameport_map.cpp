@@ -0,0 +1,96 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#include <cstring>
+#include <jw/io/gameport_map.h>
+
+namespace jw::io
+{
+    namespace
+    {
+        constexpr char magic[4] { 'J', 'W', 'G', 'P' };
+        constexpr std::uint16_t version { 1 };
+        constexpr chrono::tsc_count ref { 1'000'000 };
+
+        std::int64_t ns_per_ref()
+        {
+            const auto ns = chrono::tsc::to_duration(ref).count();
+            if (ns <= 0) throw gameport_profile_error { "TSC is not calibrated." };
+            return ns;
+        }
+
+        template<typename T>
+        void put(std::ostream& out, T value)
+        {
+            byte b[sizeof(T)];
+            for (std::size_t i = 0; i < sizeof(T); ++i) b[i] = value >> (i * 8);
+            out.write(reinterpret_cast<const char*>(b), sizeof(T));
+        }
+
+        template<typename T>
+        T get(std::istream& in)
+        {
+            byte b[sizeof(T)];
+            if (not in.read(reinterpret_cast<char*>(b), sizeof(T))) throw gameport_profile_error { "Unexpected end of file." };
+            T value { 0 };
+            for (std::size_t i = 0; i < sizeof(T); ++i) value |= static_cast<T>(b[i]) << (i * 8);
+            return value;
+        }
+
+        void put_float(std::ostream& out, float value)
+        {
+            std::uint32_t v;
+            std::memcpy(&v, &value, sizeof(v));
+            put(out, v);
+        }
+
+        float get_float(std::istream& in)
+        {
+            float value;
+            auto v = get<std::uint32_t>(in);
+            std::memcpy(&value, &v, sizeof(value));
+            return value;
+        }
+    }
+
+    void gameport_profile::save(std::ostream& file) const
+    {
+        const auto ns = ns_per_ref();
+        auto to_ns = [ns](std::uint32_t ticks) { return static_cast<std::uint32_t>(ticks * ns / ref); };
+
+        file.write(magic, sizeof(magic));
+        put(file, version);
+        for (auto i = 0; i < 4; ++i)
+        {
+            put(file, to_ns(calibration[i].min));
+            put(file, to_ns(calibration[i].center));
+            put(file, to_ns(calibration[i].max));
+            put_float(file, curve[i].deadzone);
+            put_float(file, curve[i].expo);
+            put<byte>(file, curve[i].invert);
+        }
+        if (not file) throw gameport_profile_error { "Failed to write gameport profile." };
+    }
+
+    gameport_profile gameport_profile::load(std::istream& file)
+    {
+        const auto ns = ns_per_ref();
+        auto to_ticks = [ns](std::uint32_t t) { return static_cast<std::uint32_t>(t * ref / ns); };
+
+        char m[sizeof(magic)];
+        if (not file.read(m, sizeof(m)) or std::memcmp(m, magic, sizeof(magic)) != 0) throw gameport_profile_error { "Not a gameport profile." };
+        if (get<std::uint16_t>(file) != version) throw gameport_profile_error { "Unsupported gameport profile version." };
+
+        gameport_profile p { };
+        for (auto i = 0; i < 4; ++i)
+        {
+            p.calibration[i].min = to_ticks(get<std::uint32_t>(file));
+            p.calibration[i].center = to_ticks(get<std::uint32_t>(file));
+            p.calibration[i].max = to_ticks(get<std::uint32_t>(file));
+            p.curve[i].deadzone = get_float(file);
+            p.curve[i].expo = get_float(file);
+            p.curve[i].invert = get<byte>(file) != 0;
+        }
+        return p;
+    }
+}
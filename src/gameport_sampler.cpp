@@ -0,0 +1,124 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#include <stdexcept>
+#include <jw/io/gameport_sampler.h>
+#include <jw/dpmi/irq_mask.h>
+
+namespace jw::io
+{
+    gameport_sampler::gameport_sampler(config c) : cfg(c), port(c.port)
+    {
+        if (cfg.timer == chrono::tsc_reference::none) throw std::invalid_argument { "Gameport sampler requires a timer interrupt." };
+        if (cfg.divider < 1) throw std::invalid_argument { "Divider must be at least 1." };
+        if (cfg.window < 1 or cfg.window > max_window) throw std::out_of_range { "Window size must be between 1 and 64, inclusive." };
+
+        // Convert the timeout to TSC ticks once, so the measurement loop only compares integers.
+        constexpr chrono::tsc_count ref { 1'000'000 };
+        const auto ns_per_ref = clock::to_duration(ref).count();
+        if (ns_per_ref <= 0) throw std::runtime_error { "TSC is not calibrated." };
+        timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(cfg.timeout).count() * ref / ns_per_ref;
+        axis_mask = cfg.enable.to_ulong();
+
+        stats_start = chrono::rdtsc();
+        irq.set_irq(cfg.timer == chrono::tsc_reference::rtc ? 8 : 0);
+        irq.enable();
+    }
+
+    gameport_sampler::~gameport_sampler()
+    {
+        irq.disable();
+    }
+
+    gameport_sampler::raw_t gameport_sampler::raw_counts() const
+    {
+        std::array<std::uint32_t, 4> s;
+        std::uint32_t n;
+        {
+            dpmi::interrupt_mask no_irq { };
+            s = sum;
+            n = count;
+        }
+        if (n == 0) return raw_t { 0 };
+        return raw_t { s[0] / n, s[1] / n, s[2] / n, s[3] / n };
+    }
+
+    gameport::raw_t gameport_sampler::get_raw() const
+    {
+        const auto r = raw_counts();
+        gameport::raw_t value { };
+        for (auto i = 0; i < 4; ++i)
+            value[i] = std::chrono::duration_cast<gameport::clock::duration>(clock::to_duration(r[i]));
+        return value;
+    }
+
+    gameport_sampler_stats gameport_sampler::get_stats() const
+    {
+        std::size_t n, t;
+        chrono::tsc_count b, start;
+        {
+            dpmi::interrupt_mask no_irq { };
+            n = samples;
+            t = timeouts;
+            b = busy;
+            start = stats_start;
+        }
+        return { n, t, clock::to_duration(b), clock::to_duration(chrono::rdtsc() - start) };
+    }
+
+    void gameport_sampler::reset_stats()
+    {
+        dpmi::interrupt_mask no_irq { };
+        samples = 0;
+        timeouts = 0;
+        busy = 0;
+        stats_start = chrono::rdtsc();
+    }
+
+    void gameport_sampler::sample()
+    {
+        if (++irq_count < cfg.divider) return;
+        irq_count = 0;
+
+        raw_t t { 0 };
+        byte timing = axis_mask;
+        byte p;
+        chrono::tsc_count start, now;
+        {
+            // Other interrupts would delay edge detection, so keep them out for the duration of the pulse.
+            dpmi::interrupt_mask no_irq { };
+            port.write(0);
+            start = chrono::rdtsc();
+            do
+            {
+                p = port.read();
+                now = chrono::rdtsc();
+                const std::uint32_t elapsed = now - start;
+                if (byte done = timing & ~p)
+                {
+                    for (auto i = 0; i < 4; ++i)
+                        if (done & (1 << i)) t[i] = elapsed;
+                    timing &= ~done;
+                }
+                else if (elapsed >= timeout) break;
+            } while (timing != 0);
+        }
+
+        if (timing != 0)
+        {
+            ++timeouts;
+            for (auto i = 0; i < 4; ++i)
+                if (timing & (1 << i)) t[i] = timeout;
+        }
+        button_state = (~p >> 4) & 0x0f;
+
+        auto& old = window[pos];
+        for (auto i = 0; i < 4; ++i) sum[i] += t[i] - old[i];
+        old = t;
+        if (++pos == cfg.window) pos = 0;
+        if (count < cfg.window) ++count;
+
+        ++samples;
+        busy += chrono::rdtsc() - start;
+    }
+}
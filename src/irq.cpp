@@ -6,6 +6,7 @@
 #include <jw/dpmi/irq.h>
 #include <jw/dpmi/fpu.h>
 #include <jw/alloc.h>
+#include <jw/debug/trace.h>
 
 namespace jw
 {
@@ -13,9 +14,11 @@ namespace jw
     {
         namespace detail
         {
-            void irq_controller::interrupt_entry_point(int_vector vec) noexcept
+            void irq_controller::interrupt_entry_point(int_vector vec, std::uintptr_t frame, selector frame_ss) noexcept
             {
                 ++interrupt_count;
+                auto outer_frame = interrupted_frame;
+                interrupted_frame = far_ptr32 { frame_ss, frame };
                 fpu_context_switcher.enter(0);
                 interrupt_id::push_back(vec, interrupt_id::id_t::interrupt);
                 
@@ -28,7 +31,14 @@ namespace jw
                 auto exception_msg = [] { std::cerr << "EXCEPTION AT INTERRUPT ENTRY POINT" << std::endl; };
                 auto hang = [] { do { } while (true); };
 
+                static constexpr const char* irq_names[]
+                {
+                    "irq 0", "irq 1", "irq 2", "irq 3", "irq 4", "irq 5", "irq 6", "irq 7",
+                    "irq 8", "irq 9", "irq 10", "irq 11", "irq 12", "irq 13", "irq 14", "irq 15"
+                };
                 auto i = vec_to_irq(vec);
+                const char* trace_name = i < 16 ? irq_names[i] : "interrupt";
+                debug::trace_begin(trace_name);
                 if ((i == 7 || i == 15) && !in_service()[i]) goto spurious;
 
                 try
@@ -46,8 +56,10 @@ namespace jw
                 spurious:
                 asm("cli");
                 acknowledge();
+                debug::trace_end(trace_name);
                 interrupt_id::pop_back();
                 fpu_context_switcher.leave();
+                interrupted_frame = outer_frame;
                 --interrupt_count;
             }
 
@@ -97,7 +109,9 @@ namespace jw
                     "mov esp, eax;"
                     "keep_stack%=:"
                     "and esp, -0x10;"               // Align stack
-                    "sub esp, 0xc;"
+                    "sub esp, 0x4;"
+                    "push ebx;"                     // Pass interrupted stack segment
+                    "push ebp;"                     // Pass interrupted stack frame
                     "push cs:[esi-0x1C];"           // Pass our interrupt vector
                     "call cs:[esi-0x10];"           // Call the entry point
                     "cmp bx, cs:[esi-0x26];"
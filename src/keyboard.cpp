@@ -16,36 +16,35 @@ namespace jw
         {
             try
             {
-                auto codes = ps2->get_scancodes();
-                if (codes.size() == 0) return;
-
                 auto handle_key = [this, async](key_state_pair k)
                 {
-                    if (keys[k.first].is_down() && k.second.is_down()) k.second = key_state::repeat;
+                    if (state(k.first).is_down() && k.second.is_down()) k.second = key_state::repeat;
 
-                    keys[k.first] = k.second;
+                    state(k.first) = k.second;
 
-                    keys[key::any_ctrl] = keys[key::ctrl_left] | keys[key::ctrl_right];
-                    keys[key::any_alt] = keys[key::alt_left] | keys[key::alt_right];
-                    keys[key::any_shift] = keys[key::shift_left] | keys[key::shift_right];
-                    keys[key::any_win] = keys[key::win_left] | keys[key::win_right];
+                    state(key::any_ctrl) = state(key::ctrl_left) | state(key::ctrl_right);
+                    state(key::any_alt) = state(key::alt_left) | state(key::alt_right);
+                    state(key::any_shift) = state(key::shift_left) | state(key::shift_right);
+                    state(key::any_win) = state(key::win_left) | state(key::win_right);
 
                     key_changed(k);
                 };
 
-                for (auto&& c : codes)
+                key_event e;
+                while (ps2->get_key_event(e))
                 {
-                    auto k = c.decode();
+                    timestamp = e.timestamp;
+                    key_state_pair k { e.k, e.state };
                     handle_key(k);
 
                     auto set_lock_state = [this, &handle_key](auto k, auto state_key)
                     {
-                        if (keys[k.first].is_up() and k.second.is_down())
-                            handle_key({ state_key, not keys[state_key] });
+                        if (state(k.first).is_up() and k.second.is_down())
+                            handle_key({ state_key, not state(state_key) });
 
-                        ps2->set_leds(keys[key::num_lock_state].is_down(),
-                            keys[key::caps_lock_state].is_down(),
-                            keys[key::scroll_lock_state].is_down());
+                        ps2->set_leds(state(key::num_lock_state).is_down(),
+                            state(key::caps_lock_state).is_down(),
+                            state(key::scroll_lock_state).is_down());
                     };
 
                     switch (k.first)
@@ -0,0 +1,154 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#include <algorithm>
+#include <jw/audio/midi_scheduler.h>
+#include <jw/dpmi/irq_mask.h>
+#include <jw/io/rs232.h>
+
+namespace jw::audio
+{
+    midi_scheduler::midi_scheduler(std::ostream& stream, chrono::tsc_reference timer, std::size_t max_events)
+        : out(stream), max_size(max_events)
+    {
+        if (timer == chrono::tsc_reference::none) throw std::invalid_argument { "MIDI scheduler requires a timer interrupt." };
+        if (dynamic_cast<io::detail::rs232_streambuf*>(stream.rdbuf()) != nullptr) throw std::invalid_argument { "MIDI scheduler can not write to rs232_stream from interrupt context." };
+        queue.reserve(max_size);
+        irq.set_irq(timer == chrono::tsc_reference::rtc ? 8 : 0);
+        irq.enable();
+    }
+
+    midi_scheduler::~midi_scheduler()
+    {
+        irq.disable();
+    }
+
+    bool midi_scheduler::schedule(packed_midi msg, clock::time_point t)
+    {
+        dpmi::interrupt_mask no_irq { };
+        if (queue.size() >= max_size)
+        {
+            ++stats.dropped;
+            return false;
+        }
+        push(msg, t);
+        return true;
+    }
+
+    bool midi_scheduler::schedule(const midi& msg)
+    {
+        std::vector<packed_midi> packed { };
+        std::vector<byte> sysex { };
+        packed_midi::pack(msg, packed, sysex);
+        if (not sysex.empty()) throw std::invalid_argument { "Sysex messages can not be scheduled." };
+        dpmi::interrupt_mask no_irq { };
+        if (queue.size() + packed.size() > max_size)
+        {
+            ++stats.dropped;
+            return false;
+        }
+        for (auto m : packed) push(m, msg.time);
+        return true;
+    }
+
+    void midi_scheduler::push(packed_midi msg, clock::time_point t)
+    {
+        queue.push_back({ t, sequence++, msg });
+        std::push_heap(queue.begin(), queue.end());
+    }
+
+    void midi_scheduler::start_clock(double bpm, clock::time_point t)
+    {
+        set_tempo(bpm);
+        dpmi::interrupt_mask no_irq { };
+        schedule(packed_midi { 0xfa }, t);
+        next_tick = t;
+        clock_active = true;
+    }
+
+    void midi_scheduler::set_tempo(double bpm)
+    {
+        if (bpm <= 0) throw std::invalid_argument { "Tempo must be positive." };
+        auto interval = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double> { 60.0 / (bpm * 24) });
+        dpmi::interrupt_mask no_irq { };
+        tick_interval = interval;
+    }
+
+    void midi_scheduler::stop_clock()
+    {
+        dpmi::interrupt_mask no_irq { };
+        clock_active = false;
+        schedule(packed_midi { 0xfc }, clock::time_point::min());
+    }
+
+    void midi_scheduler::clear()
+    {
+        dpmi::interrupt_mask no_irq { };
+        queue.clear();
+        pending_size = 0;
+    }
+
+    midi_scheduler_stats midi_scheduler::get_stats() const
+    {
+        dpmi::interrupt_mask no_irq { };
+        return stats;
+    }
+
+    void midi_scheduler::reset_stats()
+    {
+        dpmi::interrupt_mask no_irq { };
+        stats = { };
+    }
+
+    void midi_scheduler::add_jitter(clock::duration d) noexcept
+    {
+        ++stats.dispatched;
+        stats.total_jitter += d;
+        stats.max_jitter = std::max(stats.max_jitter, d);
+    }
+
+    void midi_scheduler::dispatch()
+    {
+        const auto now = clock::now();
+        auto* p = pending.data() + pending_size;
+        auto* const end = pending.data() + pending.size();
+
+        while (not queue.empty() and queue.front().time <= now)
+        {
+            const auto& e = queue.front();
+            const auto n = e.msg.size();
+            if (p + n > end) break;
+            *p++ = e.msg.status();
+            if (n > 1) *p++ = e.msg.data1();
+            if (n > 2) *p++ = e.msg.data2();
+            if (e.time == clock::time_point::min()) ++stats.dispatched;
+            else add_jitter(now - e.time);
+            std::pop_heap(queue.begin(), queue.end());
+            queue.pop_back();
+        }
+
+        while (clock_active and next_tick <= now and p < end)
+        {
+            *p++ = 0xf8;
+            add_jitter(now - next_tick);
+            next_tick += tick_interval;
+        }
+
+        pending_size = p - pending.data();
+        if (pending_size == 0) return;
+
+        // The stream buffer throws a deadlock exception if the main thread is writing to it, and may accept
+        // only part of the data when its buffer is full. In both cases, keep what is left and try again on
+        // the next tick.
+        try
+        {
+            auto* buf = out.rdbuf();
+            auto n = buf->sputn(reinterpret_cast<const char*>(pending.data()), pending_size);
+            if (n < 0) n = 0;
+            if (static_cast<std::size_t>(n) < pending_size) ++stats.busy;
+            std::copy(pending.begin() + n, pending.begin() + pending_size, pending.begin());
+            pending_size -= n;
+        }
+        catch (...) { ++stats.busy; }
+    }
+}
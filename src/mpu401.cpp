@@ -36,14 +36,24 @@ namespace jw
                     if (data_port.read() != 0xFE) throw std::runtime_error("Expected ACK from MPU401.");
 
                 setg(rx_buf.begin(), rx_buf.begin(), rx_buf.begin());
-                setp(tx_buf.begin(), tx_buf.end());
+                setp(tx_buf.begin(), tx_buf.end() - 1);
 
                 irq_handler.set_irq(cfg.irq);
-                if (cfg.use_irq) irq_handler.enable();
+                if (cfg.use_irq)
+                {
+                    irq_handler.enable();
+                    if (cfg.tx_timer != chrono::tsc_reference::none)
+                    {
+                        timer_handler.set_irq(cfg.tx_timer == chrono::tsc_reference::rtc ? 8 : 0);
+                        timer_handler.enable();
+                    }
+                }
+                port_use_map[cfg.port] = true;
             }
 
             mpu401_streambuf::~mpu401_streambuf()
             {
+                timer_handler.disable();
                 irq_handler.disable();
                 cmd_port.write(0xFF);
                 port_use_map[cfg.port] = false;
@@ -51,97 +61,77 @@ namespace jw
 
             int mpu401_streambuf::sync()
             {
+                put();
+                if (dpmi::in_irq_context()) return 0;   // the interrupt handlers will send the rest
                 thread::yield_while([this]
                 {
+                    if (polling())
                     {
-                        std::unique_lock<std::recursive_mutex> lock { getting };
-                        if (not status_port.read().no_data_available) underflow();
+                        get();
+                        put();
                     }
-                    overflow();
-                    return tx_ptr < pptr();
+                    return tx_tail != tx_head();
                 });
                 return 0;
             }
 
-            std::streamsize mpu401_streambuf::xsgetn(char_type * s, std::streamsize n)
+            mpu401_streambuf::int_type mpu401_streambuf::underflow()
             {
                 std::unique_lock<std::recursive_mutex> lock { getting };
-                std::streamsize max_n;
-                thread::yield_while([&]
+                if (gptr() == rx_buf.end()) setg(rx_buf.begin(), rx_buf.begin(), rx_buf.begin());
+                thread::yield_while([this]
                 {
-                    max_n = std::min(egptr() - gptr(), n);
-                    return max_n < n and underflow() != traits_type::eof();
+                    if (rx_overflow)
+                    {
+                        rx_overflow = false;
+                        throw io::overflow { "MPU401 receive buffer overflow" };
+                    }
+                    if (polling()) get();
+                    return rx_head == rx_tail();
                 });
-                {
-                    dpmi::interrupt_mask no_irq { };
-                    std::copy_n(gptr(), max_n, s);
-                    setg(rx_buf.begin(), gptr() + max_n, egptr());
-                }
-                return max_n;
-            }
 
-            mpu401_streambuf::int_type mpu401_streambuf::underflow()
-            {
-                std::unique_lock<std::recursive_mutex> lock { getting };
-                auto qsize = rx_buf.size() / 4;
-                if (rx_ptr > rx_buf.begin() + qsize * 3)
-                {
-                    dpmi::interrupt_mask no_irq { };
-                    auto offset = gptr() - (rx_buf.begin() + qsize);
-                    std::copy(rx_buf.begin() + offset, rx_ptr, rx_buf.begin());
-                    rx_ptr -= offset;
-                    setg(rx_buf.begin(), rx_buf.begin() + qsize, rx_ptr);
-                }
-                do
-                {
-                    check_irq_exception();
-                    if (not cfg.use_irq or
-                        not dpmi::interrupt_mask::enabled() or
-                        not dpmi::irq_mask::enabled(cfg.irq))
-                        get();
-                    else thread::yield();
-                } while (gptr() == rx_ptr);
-                return *gptr();
+                // The get area extends up to the last received byte, or to the end of the ring buffer.
+                const std::size_t head = rx_head;
+                auto* const end = head > rx_tail() ? rx_buf.begin() + head : rx_buf.end();
+                setg(rx_buf.begin(), gptr(), end);
+                return traits_type::to_int_type(*gptr());
             }
 
-            std::streamsize mpu401_streambuf::xsputn(const char_type * s, std::streamsize n)
+            std::streamsize mpu401_streambuf::xsputn(const char_type* s, std::streamsize n)
             {
                 std::unique_lock<std::recursive_mutex> lock { putting };
-                std::streamsize max_n;
-                while ((max_n = std::min(tx_buf.end() - pptr(), n)) < n)
-                    overflow();
-                {
-                    dpmi::interrupt_mask no_irq { };
-                    std::copy_n(s, max_n, pptr());
-                    setp(pptr() + max_n, tx_buf.end());
-                }
-                return max_n;
+                auto r = std::streambuf::xsputn(s, n);
+                put();
+                return r;
             }
 
             mpu401_streambuf::int_type mpu401_streambuf::overflow(int_type c)
             {
                 std::unique_lock<std::recursive_mutex> lock { putting };
-                thread::yield_while([this]
-                {
-                    check_irq_exception();
-                    {
-                        dpmi::interrupt_mask no_irq { };
-                        put();
-                    }
-                    return tx_ptr < pptr();
-                });
+                if (pptr() == tx_buf.end()) setp(tx_buf.begin(), tx_buf.begin());
 
-                auto hsize = tx_buf.size() / 2;
-                if (pptr() > tx_buf.begin() + hsize)
+                // The put area extends up to the byte before the one that is being sent, so that head and
+                // tail never meet.
+                auto free_end = [this]
                 {
-                    dpmi::interrupt_mask no_irq { };
-                    std::copy(tx_ptr, pptr(), tx_buf.begin());
-                    setp(tx_buf.begin() + (pptr() - tx_ptr), tx_buf.end());
-                    tx_ptr = tx_buf.begin();
+                    const std::size_t tail = tx_tail;
+                    if (tail > tx_head()) return tx_buf.begin() + tail - 1;
+                    return tail == 0 ? tx_buf.end() - 1 : tx_buf.end();
+                };
+                put();
+                if (dpmi::in_irq_context())
+                {   // can't wait here, report the buffer as full so sputn() returns a short count
+                    if (free_end() == pptr()) return traits_type::eof();
                 }
+                else thread::yield_while([&]
+                {
+                    if (polling()) put();
+                    return free_end() == pptr();
+                });
+                setp(pptr(), free_end());
 
-                if (traits_type::not_eof(c)) sputc(c);
-                return ~traits_type::eof();
+                if (not traits_type::eq_int_type(c, traits_type::eof())) return sputc(traits_type::to_char_type(c));
+                return traits_type::not_eof(c);
             }
         }
     }
@@ -0,0 +1,139 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#include <jw/debug/profiler.h>
+#include <jw/dpmi/irq_mask.h>
+#include <jw/dpmi/memory.h>
+#include <jw/thread/task.h>
+
+namespace jw
+{
+    namespace debug
+    {
+        dpmi::irq_handler profiler::irq { []() INTERRUPT { sample(); }, dpmi::always_call };
+
+        thread::task<void()> profiler::flush_task { []
+        {
+            while (is_running())
+            {
+                thread::yield_while([] { return is_running() and head == tail and lost == 0; });
+                flush();
+            }
+        } };
+
+        bool profiler::push(std::size_t& i, std::uint32_t value) noexcept
+        {
+            auto next = i + 1;
+            if (next == buffer.size()) next = 0;
+            if (next == tail) return false;
+            buffer[i] = value;
+            i = next;
+            return true;
+        }
+
+        void profiler::sample() noexcept
+        {
+            dpmi::interrupt_mask no_irq { };
+            auto frame = dpmi::irq_handler::interrupted_frame();
+            std::uint32_t eip, cs, ebp;
+            {
+                dpmi::gs_override gs { frame.segment };
+                asm("mov %0, gs:[%3+0x30];"
+                    "mov %1, gs:[%3+0x34];"
+                    "mov %2, gs:[%3+0x08];"
+                    : "=&r" (eip)
+                    , "=&r" (cs)
+                    , "=&r" (ebp)
+                    : "r" (frame.offset));
+            }
+
+            std::array<std::uint32_t, 0x100> callers;
+            std::size_t n { 0 };
+            if (static_cast<dpmi::selector>(cs) != dpmi::get_cs()) eip = 0;
+            else
+            {
+                // Walk the frame pointer chain, until it looks invalid.
+                for (auto fp = ebp; n < depth; ++n)
+                {
+                    if (fp & 3 or fp < 0x1000 or fp > stack_limit - 8) break;
+                    auto* p = reinterpret_cast<const std::uint32_t*>(fp);
+                    callers[n] = p[1];
+                    if (p[0] <= fp) { ++n; break; }
+                    fp = p[0];
+                }
+            }
+
+            auto i = head;
+            bool ok = push(i, n) and push(i, eip);
+            for (std::size_t j = 0; ok and j < n; ++j) ok = push(i, callers[j]);
+            if (ok) head = i;
+            else ++lost;
+        }
+
+        void profiler::start(std::ostream& o, source src, std::size_t max_depth, std::size_t buffer_size)
+        {
+            dpmi::throw_if_irq();
+            stop();
+            flush_task->try_await();    // let a previous run finish draining
+
+            if (max_depth > 0xfe) throw std::out_of_range { "Maximum profiler stack depth is 254." };
+            if (buffer_size < max_depth + 3) throw std::out_of_range { "Profiler buffer too small." };
+
+            out = &o;
+            buffer.resize(buffer_size);
+            head = tail = 0;
+            lost = 0;
+            depth = max_depth;
+            stack_limit = dpmi::ldt_entry::get_limit(dpmi::get_ds());
+
+            out->write("JWPROF", 6);
+            out->put(1);
+            out->put(src);
+
+            irq.set_irq(src == rtc ? 8 : 0);
+            irq.enable();
+
+            flush_task->start();
+        }
+
+        void profiler::stop()
+        {
+            dpmi::throw_if_irq();
+            if (not is_running()) return;
+            irq.disable();
+            flush_task->try_await();    // the task may be suspended inside flush(), let it finish first
+            flush();
+            out->flush();
+        }
+
+        void profiler::flush()
+        {
+            dpmi::throw_if_irq();
+            if (out == nullptr) return;
+            auto write = [](std::uint32_t value) { out->write(reinterpret_cast<const char*>(&value), sizeof(value)); };
+
+            std::uint32_t n_lost;
+            {
+                dpmi::interrupt_mask no_irq { };
+                n_lost = lost;
+                lost = 0;
+            }
+            if (n_lost > 0)
+            {
+                out->put(0xff);
+                write(n_lost);
+            }
+
+            auto end = head;
+            auto next = [](std::size_t i) { return i + 1 == buffer.size() ? 0 : i + 1; };
+            for (auto i = tail; i != end;)
+            {
+                auto n = buffer[i];
+                out->put(n);
+                i = next(i);
+                for (std::size_t j = 0; j <= n; ++j, i = next(i)) write(buffer[i]);
+                tail = i;
+            }
+        }
+    }
+}
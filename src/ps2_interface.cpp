@@ -18,12 +18,6 @@ namespace jw
 {
     namespace io
     {
-        std::deque<detail::scancode> ps2_interface::get_scancodes()
-        {
-            dpmi::irq_mask disable_irq { 1 };
-            return detail::scancode::extract(scancode_queue, get_scancode_set());
-        }
-
         void ps2_interface::reset()
         {
             irq_handler.disable();
@@ -34,6 +28,7 @@ namespace jw
 
             set_scancode_set(set3);
             enable_typematic(true);
+            decoder.reset();
 
             irq_handler.enable();
         }
@@ -43,11 +43,16 @@ namespace jw
             if (c) throw dpmi_error(error, __PRETTY_FUNCTION__);
         }
 
-        void realmode_callback::entry_point(realmode_callback* self, std::uint32_t, std::uint32_t) noexcept
+        realmode_registers* detail::realmode_callback_impl::entry_point(realmode_callback_impl* self, std::uint32_t, std::uint32_t) noexcept
         {
-            auto* reg = self->reg_ptr;
-            self->reg_pool.push_back({ });
-            self->reg_ptr = &self->reg_pool.back();
+            if (__builtin_expect(self->depth == self->max_depth, false))
+            {
+                self->reg.flags.carry = true;
+                return &self->reg;
+            }
+
+            auto* reg = &self->reg_slots[self->depth++];
+            self->stack_ptr = self->depth < self->max_depth ? self->stack_top(self->depth) : nullptr;
             *reg = self->reg;
             bool is_irq = !reg->flags.interrupt;
             if (is_irq) ++detail::interrupt_count;
@@ -70,11 +75,12 @@ namespace jw
 
             asm("cli");
             if (is_irq) --detail::interrupt_count;
-            self->reg_pool.pop_back();
-            self->reg_ptr = &self->reg_pool.back();
+            --self->depth;
+            self->stack_ptr = self->stack_top(self->depth);
+            return reg;
         }
 
-        void realmode_callback::init_code() noexcept
+        void detail::realmode_callback_impl::init_code() noexcept
         {
             byte* start;
             std::size_t size;
@@ -97,25 +103,30 @@ namespace jw
                 "mov dx, ds;"
                 "movzx edx, dx;"
                 "push es; pop ds;"
-                "mov fs, word ptr cs:[eax-0x19];"
-                "mov gs, word ptr cs:[eax-0x17];"
+                "mov fs, word ptr cs:[eax-0x15];"
+                "mov gs, word ptr cs:[eax-0x13];"
                 "mov ebp, esp;"
                 "mov bx, ss;"
                 "mov cx, ds;"
                 "cmp bx, cx;"
                 "je keep_stack%=;"
+                "mov ecx, cs:[eax-0x0D];"       // Stack for this nesting level
+                "jecxz no_stack%=;"
                 "push ds; pop ss;"
-                "mov esp, cs:[eax-0x11];"
+                "mov esp, ecx;"
                 "keep_stack%=:"
-                "mov edi, cs:[eax-0x0D];"       // Pointer to temporary register struct
                 "and esp, -0x10;"               // Align stack
                 "push esi;"                     // Real-mode stack offset
                 "push edx;"                     // Real-mode stack selector
                 "push cs:[eax-0x09];"           // Pointer to self
-                "call cs:[eax-0x15];"           // Call the entry point
+                "call cs:[eax-0x11];"           // Call the entry point
+                "mov edi, eax;"                 // Returned register struct
                 "mov ss, bx;"
                 "mov esp, ebp;"
                 "iret;"
+                "no_stack%=:"                   // All stacks in use, return with carry set
+                "or byte ptr es:[edi+0x20], 1;"
+                "iret;"
 
                 "realmode_callback_wrapper_end%=:"
                 // --- /\/\/\/\/\/\ --- //
@@ -133,9 +144,6 @@ namespace jw
             if (ldt_entry::get_limit(get_cs()) < cs_limit) 
                 ldt_entry::set_limit(get_cs(), cs_limit);
 
-            reg_pool.push_back({ });
-            reg_ptr = &reg_pool.back();
-
             asm volatile (
                 "mov %w0, fs;"
                 "mov %w1, gs;"
@@ -2,53 +2,197 @@
 /* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
 /* Copyright (C) 2016 J.W. Jagersma, see COPYING.txt for details */
 
-#include <iostream>
-#include <unordered_map>
+#include <array>
 #include <jw/io/detail/scancode.h>
 
-//TODO: I don't really like all the dynamic allocation going on here.
 namespace jw
 {
     namespace io
     {
         namespace detail
         {
-            key_state_pair scancode::decode()
+            namespace
             {
-                key_state_pair k;
-                k.second = key_state::down;
+                using key_table = std::array<std::uint16_t, 0x100>;
 
-                bool ext0 = false;
-                bool ext1 = false;
+                // Set 3 scancode to key. Unknown codes map to 0100-01FF.
+                constexpr key_table set3_to_key = []
+                {
+                    key_table t { };
+                    for (unsigned i = 0; i < t.size(); ++i) t[i] = 0x0100 + i;
+                    t[0x00] = key::bad_key;
+                    t[0x07] = key::f1;
+                    t[0x08] = key::esc;
+                    t[0x0D] = key::tab;
+                    t[0x0E] = key::backtick;
+                    t[0x0F] = key::f2;
+                    t[0x11] = key::ctrl_left;
+                    t[0x12] = key::shift_left;
+                    t[0x14] = key::caps_lock;
+                    t[0x15] = key::q;
+                    t[0x16] = key::n1;
+                    t[0x17] = key::f3;
+                    t[0x19] = key::alt_left;
+                    t[0x1A] = key::z;
+                    t[0x1B] = key::s;
+                    t[0x1C] = key::a;
+                    t[0x1D] = key::w;
+                    t[0x1E] = key::n2;
+                    t[0x1F] = key::f4;
+                    t[0x21] = key::c;
+                    t[0x22] = key::x;
+                    t[0x23] = key::d;
+                    t[0x24] = key::e;
+                    t[0x25] = key::n4;
+                    t[0x26] = key::n3;
+                    t[0x27] = key::f5;
+                    t[0x29] = key::space;
+                    t[0x2A] = key::v;
+                    t[0x2B] = key::f;
+                    t[0x2C] = key::t;
+                    t[0x2D] = key::r;
+                    t[0x2E] = key::n5;
+                    t[0x2F] = key::f6;
+                    t[0x31] = key::n;
+                    t[0x32] = key::b;
+                    t[0x33] = key::h;
+                    t[0x34] = key::g;
+                    t[0x35] = key::y;
+                    t[0x36] = key::n6;
+                    t[0x37] = key::f7;
+                    t[0x39] = key::alt_right;
+                    t[0x3A] = key::m;
+                    t[0x3B] = key::j;
+                    t[0x3C] = key::u;
+                    t[0x3D] = key::n7;
+                    t[0x3E] = key::n8;
+                    t[0x3F] = key::f8;
+                    t[0x41] = key::comma;
+                    t[0x42] = key::k;
+                    t[0x43] = key::i;
+                    t[0x44] = key::o;
+                    t[0x45] = key::n0;
+                    t[0x46] = key::n9;
+                    t[0x47] = key::f9;
+                    t[0x49] = key::dot;
+                    t[0x4A] = key::slash;
+                    t[0x4B] = key::l;
+                    t[0x4C] = key::semicolon;
+                    t[0x4D] = key::p;
+                    t[0x4E] = key::minus;
+                    t[0x4F] = key::f10;
+                    t[0x52] = key::quote;
+                    t[0x54] = key::brace_left;
+                    t[0x55] = key::equals;
+                    t[0x56] = key::f11;
+                    t[0x57] = key::print_screen;
+                    t[0x58] = key::ctrl_right;
+                    t[0x59] = key::shift_right;
+                    t[0x5A] = key::enter;
+                    t[0x5B] = key::brace_right;
+                    t[0x5C] = key::backslash;
+                    t[0x5E] = key::f12;
+                    t[0x5F] = key::scroll_lock;
+                    t[0x60] = key::down;
+                    t[0x61] = key::left;
+                    t[0x62] = key::pause;
+                    t[0x63] = key::up;
+                    t[0x64] = key::del;
+                    t[0x65] = key::end;
+                    t[0x66] = key::backspace;
+                    t[0x67] = key::insert;
+                    t[0x69] = key::num_1;
+                    t[0x6A] = key::right;
+                    t[0x6B] = key::num_4;
+                    t[0x6C] = key::num_7;
+                    t[0x6D] = key::page_down;
+                    t[0x6E] = key::home;
+                    t[0x6F] = key::page_up;
+                    t[0x70] = key::num_0;
+                    t[0x71] = key::num_dot;
+                    t[0x72] = key::num_2;
+                    t[0x73] = key::num_5;
+                    t[0x74] = key::num_6;
+                    t[0x75] = key::num_8;
+                    t[0x76] = key::num_lock;
+                    t[0x77] = key::num_div;
+                    t[0x79] = key::num_enter;
+                    t[0x7A] = key::num_3;
+                    t[0x7C] = key::num_add;
+                    t[0x7D] = key::num_9;
+                    t[0x7E] = key::num_mul;
+                    t[0x7F] = key::pwr_sleep;
+                    t[0x84] = key::num_sub;
+                    t[0x8B] = key::win_left;
+                    t[0x8C] = key::win_right;
+                    t[0x8D] = key::win_menu;
+                    return t;
+                }();
+
+                // Set 2 scancode to key, through the equivalent set 3 code.
+                constexpr key_table set2_to_key = []
+                {
+                    std::array<raw_scancode, 0x100> t { };
+                    for (unsigned i = 0; i < t.size(); ++i) t[i] = i;
+                    t[0x01] = 0x47; t[0x03] = 0x27; t[0x04] = 0x17; t[0x05] = 0x07;
+                    t[0x06] = 0x0F; t[0x07] = 0x5E; t[0x09] = 0x4F; t[0x0A] = 0x3F;
+                    t[0x0B] = 0x2F; t[0x0C] = 0x1F; t[0x11] = 0x19; t[0x14] = 0x11;
+                    t[0x58] = 0x14; t[0x5D] = 0x5C; t[0x76] = 0x08; t[0x77] = 0x76;
+                    t[0x78] = 0x56; t[0x79] = 0x7C; t[0x7B] = 0x84; t[0x7C] = 0x7E;
+                    t[0x7E] = 0x5F; t[0x83] = 0x37; t[0x84] = 0x57;
+                    key_table k { };
+                    for (unsigned i = 0; i < k.size(); ++i) k[i] = set3_to_key[t[i]];
+                    return k;
+                }();
 
-                for (auto c : sequence)
+                // Set 2 scancode following E0 to key. Unknown codes map to E000-E0FF.
+                constexpr key_table set2_extended0_to_key = []
                 {
-                    if (c == 0xF0) { k.second = key_state::up; continue; }
-                    switch (code_set)
+                    key_table t { };
+                    for (unsigned i = 0; i < t.size(); ++i) t[i] = 0xE000 + i;
+                    t[0x11] = set3_to_key[0x39]; t[0x14] = set3_to_key[0x58];
+                    t[0x1F] = set3_to_key[0x8B]; t[0x27] = set3_to_key[0x8C];
+                    t[0x2F] = set3_to_key[0x8D]; t[0x3F] = set3_to_key[0x7F];
+                    t[0x4A] = set3_to_key[0x77]; t[0x5A] = set3_to_key[0x79];
+                    t[0x69] = set3_to_key[0x65]; t[0x6B] = set3_to_key[0x61];
+                    t[0x6C] = set3_to_key[0x6E]; t[0x70] = set3_to_key[0x67];
+                    t[0x71] = set3_to_key[0x64]; t[0x72] = set3_to_key[0x60];
+                    t[0x74] = set3_to_key[0x6A]; t[0x75] = set3_to_key[0x63];
+                    t[0x7A] = set3_to_key[0x6D]; t[0x7C] = set3_to_key[0x57];
+                    t[0x7D] = set3_to_key[0x6F]; t[0x7E] = set3_to_key[0x62];
+                    t[0x37] = key::pwr_on;
+                    t[0x5E] = key::pwr_wake;
+                    return t;
+                }();
+
+                // Set 2 scancode following E1 to key. Unknown codes map to E100-E1FF.
+                constexpr key_table set2_extended1_to_key = []
+                {
+                    key_table t { };
+                    for (unsigned i = 0; i < t.size(); ++i) t[i] = 0xE100 + i;
+                    t[0x14] = key::pause;
+                    return t;
+                }();
+            }
+
+            bool scancode_decoder::operator()(raw_scancode c, scancode_set set, key_state_pair& k) noexcept
+            {
+                if (c == 0xF0) { release = true; return false; }
+                if (set != set3 and (c == 0xE0 or c == 0xE1)) { prefix = c; return false; }
+
+                const key_table* table = &set3_to_key;
+                if (set != set3)
+                {
+                    switch (prefix)
                     {
-                    case set1:
-                    case set2:
-                        if (c == 0xE0) { ext0 = true; continue; }
-                        if (c == 0xE1) { ext1 = true; continue; }
-                        if (ext0)
-                        {
-                            if (set2_extended0_to_key_table.count(c)) { k.first = set2_extended0_to_key_table[c]; continue; }
-                            if (set2_extended0_to_set3_table.count(c)) { c = set2_extended0_to_set3_table[c]; }
-                            else { k.first = 0xE000 + c; continue; }
-                        }
-                        else if (ext1)
-                        {
-                            if (c == 0x14) { k.first = key::pause; continue; }
-                            else { k.first = 0xE100 + c; continue; }
-                        }
-                        else if (set2_to_set3_table.count(c)) { c = set2_to_set3_table[c]; }
-                        [[fallthrough]];
-                    case set3:
-                        if (set3_to_key_table.count(c)) { k.first = set3_to_key_table[c]; }
-                        else { k.first = 0x0100 + c; }
+                    case 0xE0: table = &set2_extended0_to_key; break;
+                    case 0xE1: table = &set2_extended1_to_key; break;
+                    default: table = &set2_to_key;
                     }
                 }
-                return k;
+                k = { (*table)[c], release ? key_state::up : key_state::down };
+                reset();
+                return true;
             }
 
             /*
@@ -96,179 +240,6 @@ namespace jw
                 0xE0, 0xE1, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xEB, 0xEC, 0xED, 0xEE, 0xEF,
                 0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0x00
             };
-
-            std::unordered_map<raw_scancode, raw_scancode> scancode::set2_to_set3_table
-            {
-                { 0x01, 0x47 }, { 0x03, 0x27 }, { 0x04, 0x17 }, { 0x05,0x07 },
-                { 0x06, 0x0F }, { 0x07, 0x5E }, { 0x09, 0x4F }, { 0x0A,0x3F },
-                { 0x0B, 0x2F }, { 0x0C, 0x1F }, { 0x11, 0x19 }, { 0x14,0x11 },
-                { 0x58, 0x14 }, { 0x5D, 0x5C }, { 0x76, 0x08 }, { 0x77,0x76 },
-                { 0x78, 0x56 }, { 0x79, 0x7C }, { 0x7B, 0x84 }, { 0x7C,0x7E },
-                { 0x7E, 0x5F }, { 0x83, 0x37 }, { 0x84, 0x57 }
-            };
-
-            std::unordered_map<raw_scancode, const raw_scancode> scancode::set2_extended0_to_set3_table
-            {
-                { 0x11, 0x39 }, { 0x14, 0x58 }, { 0x1F, 0x8B }, { 0x27, 0x8C },
-                { 0x2F, 0x8D }, { 0x3F, 0x7F }, { 0x4A, 0x77 }, { 0x5A, 0x79 },
-                { 0x69, 0x65 }, { 0x6B, 0x61 }, { 0x6C, 0x6E }, { 0x70, 0x67 },
-                { 0x71, 0x64 }, { 0x72, 0x60 }, { 0x74, 0x6A }, { 0x75, 0x63 },
-                { 0x7A, 0x6D }, { 0x7C, 0x57 }, { 0x7D, 0x6F }, { 0x7E, 0x62 }
-            };
-
-            std::unordered_map<raw_scancode, const raw_scancode> scancode::set2_extended0_to_key_table
-            {
-                { 0x37, key::pwr_on },
-                { 0x5E, key::pwr_wake }
-            };
-
-            std::unordered_map<raw_scancode, key> scancode::set3_to_key_table
-            {
-                { 0x00, key::bad_key },
-                //{ 0x01, key:: },
-                //{ 0x02, key:: },
-                //{ 0x03, key:: },
-                //{ 0x04, key:: },
-                //{ 0x05, key:: },
-                //{ 0x06, key:: },
-                { 0x07, key::f1 },
-                { 0x08, key::esc },
-                //{ 0x09, key:: },
-                //{ 0x0A, key:: },
-                //{ 0x0B, key:: },
-                //{ 0x0C, key:: },
-                { 0x0D, key::tab },
-                { 0x0E, key::backtick },
-                { 0x0F, key::f2 },
-                //{ 0x10, key:: },
-                { 0x11, key::ctrl_left },
-                { 0x12, key::shift_left },
-                //{ 0x13, key:: },
-                { 0x14, key::caps_lock },
-                { 0x15, key::q },
-                { 0x16, key::n1 },
-                { 0x17, key::f3 },
-                //{ 0x18, key:: },
-                { 0x19, key::alt_left },
-                { 0x1A, key::z },
-                { 0x1B, key::s },
-                { 0x1C, key::a },
-                { 0x1D, key::w },
-                { 0x1E, key::n2 },
-                { 0x1F, key::f4 },
-                //{ 0x20, key:: },
-                { 0x21, key::c },
-                { 0x22, key::x },
-                { 0x23, key::d },
-                { 0x24, key::e },
-                { 0x25, key::n4 },
-                { 0x26, key::n3 },
-                { 0x27, key::f5 },
-                //{ 0x28, key:: },
-                { 0x29, key::space },
-                { 0x2A, key::v },
-                { 0x2B, key::f },
-                { 0x2C, key::t },
-                { 0x2D, key::r },
-                { 0x2E, key::n5 },
-                { 0x2F, key::f6 },
-                //{ 0x30, key:: },
-                { 0x31, key::n },
-                { 0x32, key::b },
-                { 0x33, key::h },
-                { 0x34, key::g },
-                { 0x35, key::y },
-                { 0x36, key::n6 },
-                { 0x37, key::f7 },
-                //{ 0x38, key:: },
-                { 0x39, key::alt_right },
-                { 0x3A, key::m },
-                { 0x3B, key::j },
-                { 0x3C, key::u },
-                { 0x3D, key::n7 },
-                { 0x3E, key::n8 },
-                { 0x3F, key::f8 },
-                //{ 0x40, key:: },
-                { 0x41, key::comma },
-                { 0x42, key::k },
-                { 0x43, key::i },
-                { 0x44, key::o },
-                { 0x45, key::n0 },
-                { 0x46, key::n9 },
-                { 0x47, key::f9 },
-                //{ 0x48, key:: },
-                { 0x49, key::dot },
-                { 0x4A, key::slash },
-                { 0x4B, key::l },
-                { 0x4C, key::semicolon },
-                { 0x4D, key::p },
-                { 0x4E, key::minus },
-                { 0x4F, key::f10 },
-                //{ 0x50, key:: },
-                //{ 0x51, key:: },
-                { 0x52, key::quote },
-                //{ 0x53, key:: },
-                { 0x54, key::brace_left },
-                { 0x55, key::equals },
-                { 0x56, key::f11 },
-                { 0x57, key::print_screen },
-                { 0x58, key::ctrl_right },
-                { 0x59, key::shift_right },
-                { 0x5A, key::enter },
-                { 0x5B, key::brace_right },
-                { 0x5C, key::backslash },
-                //{ 0x5D, key:: },
-                { 0x5E, key::f12 },
-                { 0x5F, key::scroll_lock },
-                { 0x60, key::down },
-                { 0x61, key::left },
-                { 0x62, key::pause },
-                { 0x63, key::up },
-                { 0x64, key::del },
-                { 0x65, key::end },
-                { 0x66, key::backspace },
-                { 0x67, key::insert },
-                //{ 0x68, key:: },
-                { 0x69, key::num_1 },
-                { 0x6A, key::right },
-                { 0x6B, key::num_4 },
-                { 0x6C, key::num_7 },
-                { 0x6D, key::page_down },
-                { 0x6E, key::home },
-                { 0x6F, key::page_up },
-                { 0x70, key::num_0 },
-                { 0x71, key::num_dot },
-                { 0x72, key::num_2 },
-                { 0x73, key::num_5 },
-                { 0x74, key::num_6 },
-                { 0x75, key::num_8 },
-                { 0x76, key::num_lock },
-                { 0x77, key::num_div },
-                //{ 0x78, key:: },
-                { 0x79, key::num_enter },
-                { 0x7A, key::num_3 },
-                //{ 0x7B, key:: },
-                { 0x7C, key::num_add },
-                { 0x7D, key::num_9 },
-                { 0x7E, key::num_mul },
-                { 0x7F, key::pwr_sleep },
-                //{ 0x80, key:: },
-                //{ 0x81, key:: },
-                //{ 0x82, key:: },
-                //{ 0x83, key:: },
-                { 0x84, key::num_sub },
-                //{ 0x85, key:: },
-                //{ 0x86, key:: },
-                //{ 0x87, key:: },
-                //{ 0x88, key:: },
-                //{ 0x89, key:: },
-                //{ 0x8A, key:: },
-                { 0x8B, key::win_left },
-                { 0x8C, key::win_right },
-                { 0x8D, key::win_menu },
-                //{ 0x8E, key:: },
-                //{ 0x8F, key:: },
-            };
         }
     }
 }
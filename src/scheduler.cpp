@@ -9,6 +9,7 @@
 #include <jw/thread/thread.h>
 #include <jw/debug/debug.h>
 #include <jw/debug/detail/signals.h>
+#include <jw/debug/trace.h>
 
 namespace jw
 {
@@ -201,13 +202,14 @@ namespace jw
 
                     if (__builtin_expect(current_thread->pending_exceptions() != 0, false)) break;
                     if (__builtin_expect(current_thread->awaiting && current_thread->awaiting->pending_exceptions() != 0, false)) break;
-                    if (__builtin_expect(current_thread->state != suspended, true)) return;
+                    if (__builtin_expect(current_thread->state != suspended, true)) break;
                     if (i > threads.size())
                     {
                         debug::break_with_signal(debug::detail::all_threads_suspended);
                         i = 0;
                     }
                 }
+                debug::trace_thread_switch(current_thread->id());
             }
         }
     }
@@ -0,0 +1,336 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+#include <jw/audio/smf.h>
+
+namespace jw::audio
+{
+    namespace
+    {
+        constexpr std::uint32_t be32(const byte* p) noexcept { return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+        constexpr std::uint16_t be16(const byte* p) noexcept { return (p[0] << 8) | p[1]; }
+    }
+
+    smf_reader::smf_reader(std::istream& f, clock::time_point t, std::size_t block)
+        : file(f), block_size(block), start(t)
+    {
+        auto* buf = file.rdbuf();
+        std::streamoff pos = buf->pubseekoff(0, std::ios::cur, std::ios::in);
+        std::array<byte, 14> header;
+        if (buf->sgetn(reinterpret_cast<char*>(header.data()), header.size()) != header.size()
+            or std::memcmp(header.data(), "MThd", 4) != 0) throw smf_error { "Not a MIDI file." };
+
+        type = be16(&header[8]);
+        std::size_t num_tracks = be16(&header[10]);
+        div = be16(&header[12]);
+        if (type > 1) throw smf_error { "Unsupported MIDI file format." };
+        if (div == 0) throw smf_error { "Invalid time division." };
+
+        if (div & 0x8000)   // SMPTE time code, frames per second and ticks per frame
+        {
+            const int fps = -static_cast<std::int8_t>(div >> 8);
+            tick_num = (fps == 29) ? 1'001'000'000 : 1'000'000'000;     // 29.97 fps drop-frame
+            tick_den = ((fps == 29) ? 30 : fps) * (div & 0xff);
+            if (tick_den == 0) throw smf_error { "Invalid time division." };
+        }
+        else set_tempo(0, 500'000);
+
+        // Locate the track chunks, skipping any unknown chunk types.
+        pos += 8 + be32(&header[4]);
+        while (track_list.size() < num_tracks)
+        {
+            std::array<byte, 8> chunk;
+            buf->pubseekpos(pos, std::ios::in);
+            if (buf->sgetn(reinterpret_cast<char*>(chunk.data()), chunk.size()) != chunk.size()) break;
+            const std::streamoff size = be32(&chunk[4]);
+            if (std::memcmp(chunk.data(), "MTrk", 4) == 0) track_list.push_back(track { pos + 8, pos + 8 + size });
+            pos += 8 + size;
+        }
+
+        blocks.resize(track_list.size() * block_size);
+        heap.reserve(track_list.size());
+        for (std::size_t i = 0; i < track_list.size(); ++i)
+        {
+            if (track_list[i].pos == track_list[i].end) continue;
+            track_list[i].tick = get_vlq(i);
+            heap.push_back(i);
+        }
+        std::make_heap(heap.begin(), heap.end(), [this](auto a, auto b) { return std::tie(track_list[a].tick, a) > std::tie(track_list[b].tick, b); });
+    }
+
+    std::optional<smf_event> smf_reader::next()
+    {
+        auto later = [this](auto a, auto b) { return std::tie(track_list[a].tick, a) > std::tie(track_list[b].tick, b); };
+        while (pending_pos == pending.size())
+        {
+            pending.clear();
+            pending_pos = 0;
+            if (heap.empty()) return std::nullopt;
+
+            std::pop_heap(heap.begin(), heap.end(), later);
+            const auto i = heap.back();
+            auto& t = track_list[i];
+            read_event(i);
+            if (t.done or (t.head == t.tail and t.pos == t.end)) heap.pop_back();
+            else
+            {
+                t.tick += get_vlq(i);
+                std::push_heap(heap.begin(), heap.end(), later);
+            }
+        }
+        return std::move(pending[pending_pos++]);
+    }
+
+    void smf_reader::fill(std::size_t i)
+    {
+        auto& t = track_list[i];
+        const std::size_t n = std::min<std::streamoff>(block_size, t.end - t.pos);
+        if (n == 0) throw smf_error { "Unexpected end of track." };
+        auto* buf = file.rdbuf();
+        if (file_pos != t.pos) buf->pubseekpos(t.pos, std::ios::in);
+        const std::size_t r = buf->sgetn(reinterpret_cast<char*>(block(i)), n);
+        file_pos = t.pos + r;
+        if (r != n) throw smf_error { "Unexpected end of file." };
+        t.pos += n;
+        t.head = 0;
+        t.tail = n;
+    }
+
+    byte smf_reader::get(std::size_t i)
+    {
+        auto& t = track_list[i];
+        if (t.head == t.tail) fill(i);
+        return block(i)[t.head++];
+    }
+
+    std::uint32_t smf_reader::get_vlq(std::size_t i)
+    {
+        std::uint32_t value { 0 };
+        for (int n = 0; n < 4; ++n)
+        {
+            const byte b = get(i);
+            value = (value << 7) | (b & 0x7f);
+            if ((b & 0x80) == 0) return value;
+        }
+        throw smf_error { "Invalid variable-length number." };
+    }
+
+    // Calls f(const byte*, std::size_t) for each contiguous part of the next n bytes in the block buffer.
+    template<typename F>
+    void smf_reader::get_bytes(std::size_t i, std::size_t n, F&& f)
+    {
+        auto& t = track_list[i];
+        while (n > 0)
+        {
+            if (t.head == t.tail) fill(i);
+            const auto size = std::min(n, t.tail - t.head);
+            f(block(i) + t.head, size);
+            t.head += size;
+            n -= size;
+        }
+    }
+
+    void smf_reader::read_event(std::size_t i)
+    {
+        auto& t = track_list[i];
+        const auto time = time_at(t.tick);
+        auto emit = [&](midi&& m) { pending.push_back(smf_event { std::move(m), t.tick, i }); };
+        auto parse = [&](const byte* data, std::size_t size) { t.parser.parse(data, size, time, emit); };
+
+        const byte b = get(i);
+        if (b < 0xf0)           // channel message
+        {
+            if (b & 0x80) t.status = b;
+            else if (t.status == 0) throw smf_error { "Data byte without running status." };
+            std::array<byte, 3> msg { b };
+            const std::size_t size = detail::midi_data_length[t.status & 0x7f] + (b >> 7);
+            for (std::size_t n = 1; n < size; ++n) msg[n] = get(i);
+            parse(msg.data(), size);
+        }
+        else if (b == 0xf0 or b == 0xf7)
+        {
+            // Sysex, or an escape sequence of arbitrary bytes. Both are passed through the parser, so that
+            // sysex messages split over multiple events are put back together.
+            const auto size = get_vlq(i);
+            if (b == 0xf0) parse(&b, 1);
+            get_bytes(i, size, parse);
+            t.status = 0;
+        }
+        else if (b == 0xff)     // meta event
+        {
+            // Running status is kept across meta events, as many files rely on it.
+            const byte meta = get(i);
+            const auto size = get_vlq(i);
+            if (meta == 0x51 and size == 3 and not (div & 0x8000))
+            {
+                std::uint32_t tempo = get(i) << 16;
+                tempo |= get(i) << 8;
+                tempo |= get(i);
+                set_tempo(t.tick, tempo);
+            }
+            else get_bytes(i, size, [](auto*, auto) { });
+            if (meta == 0x2f) t.done = true;
+        }
+        else throw smf_error { "Invalid event in MIDI file." };
+    }
+
+    void smf_reader::set_tempo(std::uint32_t tick, std::uint32_t us_per_quarter) noexcept
+    {
+        base_time = time_at(tick) - start;
+        base_tick = tick;
+        tick_num = us_per_quarter * 1000ull;
+        tick_den = div;
+    }
+
+    smf_reader::clock::time_point smf_reader::time_at(std::uint32_t tick) const noexcept
+    {
+        if (tick == base_tick) return start + std::chrono::duration_cast<clock::duration>(base_time);
+        const std::chrono::nanoseconds dt { (tick - base_tick) * tick_num / tick_den };
+        return start + std::chrono::duration_cast<clock::duration>(base_time + dt);
+    }
+
+    smf_writer::smf_writer(std::ostream& file, std::uint16_t division, clock::time_point start)
+        : out(file), tempo_map({ tempo_change { start, 0, 500'000 } }), div(division)
+    {
+        if (div == 0 or div & 0x8000) throw std::invalid_argument { "Division must be in ticks per quarter note." };
+        header_pos = out.tellp();
+        const byte header[] { 'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 0, static_cast<byte>(div >> 8), static_cast<byte>(div) };
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        new_track();
+    }
+
+    smf_writer::~smf_writer()
+    {
+        try { finish(); }
+        catch (...) { }
+    }
+
+    void smf_writer::new_track()
+    {
+        end_track();
+        track_pos = out.tellp();
+        const byte header[] { 'M', 'T', 'r', 'k', 0, 0, 0, 0 };
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        track_size = 0;
+        last_tick = 0;
+        last_status = 0;
+        in_track = true;
+        ++track_count;
+    }
+
+    void smf_writer::write(const midi& msg, std::uint32_t tick)
+    {
+        if (not in_track) throw std::logic_error { "MIDI file already finished." };
+        if (tick < last_tick) throw std::invalid_argument { "Events must be written in order of time." };
+        packed.clear();
+        sysex.clear();
+        packed_midi::pack(msg, packed, sysex);
+
+        for (auto m : packed)
+        {
+            put_delta(tick);
+            const byte status = m.status();
+            if (m.is_sysex())
+            {
+                buffer.push_back(0xf0);
+                put_vlq(sysex.size() - 1);
+                buffer.insert(buffer.end(), sysex.begin() + 1, sysex.end());
+                last_status = 0;
+            }
+            else if (status < 0xf0)
+            {
+                if (status != last_status) buffer.push_back(status);
+                last_status = status;
+                buffer.push_back(m.data1());
+                if (m.size() > 2) buffer.push_back(m.data2());
+            }
+            else    // system common and realtime messages are stored as escape sequences
+            {
+                buffer.push_back(0xf7);
+                put_vlq(m.size());
+                buffer.push_back(status);
+                if (m.size() > 1) buffer.push_back(m.data1());
+                if (m.size() > 2) buffer.push_back(m.data2());
+                last_status = 0;
+            }
+        }
+        flush();
+    }
+
+    void smf_writer::set_tempo(std::uint32_t us_per_quarter, clock::time_point t)
+    {
+        if (not in_track) throw std::logic_error { "MIDI file already finished." };
+        if (us_per_quarter == 0 or us_per_quarter > 0xffffff) throw std::invalid_argument { "Invalid tempo." };
+        if (t < tempo_map.back().time) throw std::invalid_argument { "Tempo changes must be written in order of time." };
+        const auto tick = tick_at(t);
+        if (tick < last_tick) throw std::invalid_argument { "Events must be written in order of time." };
+        tempo_map.push_back(tempo_change { t, tick, us_per_quarter });
+
+        put_delta(tick);
+        const byte meta[] { 0xff, 0x51, 3, static_cast<byte>(us_per_quarter >> 16), static_cast<byte>(us_per_quarter >> 8), static_cast<byte>(us_per_quarter) };
+        buffer.insert(buffer.end(), std::begin(meta), std::end(meta));
+        flush();
+    }
+
+    std::uint32_t smf_writer::tick_at(clock::time_point t) const noexcept
+    {
+        if (t <= tempo_map.front().time) return 0;
+        auto i = std::upper_bound(tempo_map.begin(), tempo_map.end(), t, [](auto a, const auto& c) { return a < c.time; }) - 1;
+        const std::uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t - i->time).count();
+        return i->tick + ns * div / (i->us_per_quarter * 1000ull);
+    }
+
+    void smf_writer::finish()
+    {
+        if (not in_track) return;
+        end_track();
+        const auto end = out.tellp();
+        const byte format = track_count > 1 ? 1 : 0;
+        const byte header[] { 0, format, static_cast<byte>(track_count >> 8), static_cast<byte>(track_count) };
+        out.seekp(header_pos + std::streamoff { 8 });
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        out.seekp(end);
+        out.flush();
+    }
+
+    void smf_writer::put_vlq(std::uint32_t value)
+    {
+        std::array<byte, 5> vlq;
+        auto* p = vlq.end();
+        *--p = value & 0x7f;
+        while (value >>= 7) *--p = 0x80 | (value & 0x7f);
+        buffer.insert(buffer.end(), p, vlq.end());
+    }
+
+    void smf_writer::put_delta(std::uint32_t tick)
+    {
+        put_vlq(tick - last_tick);
+        last_tick = tick;
+    }
+
+    void smf_writer::end_track()
+    {
+        if (not in_track) return;
+        const byte end_of_track[] { 0xff, 0x2f, 0 };
+        put_delta(last_tick);
+        buffer.insert(buffer.end(), std::begin(end_of_track), std::end(end_of_track));
+        flush();
+
+        const auto end = out.tellp();
+        const byte size[] { static_cast<byte>(track_size >> 24), static_cast<byte>(track_size >> 16), static_cast<byte>(track_size >> 8), static_cast<byte>(track_size) };
+        out.seekp(track_pos + std::streamoff { 4 });
+        out.write(reinterpret_cast<const char*>(size), sizeof(size));
+        out.seekp(end);
+        in_track = false;
+    }
+
+    void smf_writer::flush()
+    {
+        out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        track_size += buffer.size();
+        buffer.clear();
+    }
+}
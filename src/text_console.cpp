@@ -0,0 +1,184 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#include <algorithm>
+#include <iostream>
+#include <jw/video/text_console.h>
+
+namespace jw
+{
+    namespace video
+    {
+        text_console::text_console()
+            : bios_data_area(std::make_unique<dpmi::mapped_dos_memory<byte>>(256, dpmi::far_ptr16 { 0x40, 0 }))
+            , crtc_index(bda<std::uint16_t>(0x63)), crtc_data(bda<std::uint16_t>(0x63) + 1)
+            , shadow(bda_size())
+        {
+            const std::size_t size = shadow.width() * shadow.height();
+            const std::uint16_t segment = (bda<std::uint16_t>(0x63) == 0x3b4) ? 0xb000 : 0xb800;
+            screen = std::make_unique<dpmi::mapped_dos_memory<text_char>>(size, dpmi::far_ptr16 { segment, bda<std::uint16_t>(0x4e) });
+
+            // Start out with what is currently on screen.
+            last.assign(screen->get_ptr(), screen->get_ptr() + size);
+            std::copy(last.begin(), last.end(), buffer().data());
+            const auto page = bda<byte>(0x62);
+            cursor = { bda<byte>(0x50 + page * 2), bda<byte>(0x51 + page * 2) };
+            hw_cursor = cursor;
+        }
+
+        text_console::~text_console() { restore_cout(); }
+
+        void text_console::put(char c)
+        {
+            const auto w = shadow.width(), h = shadow.height();
+            switch (c)
+            {
+            case '\n': cursor = { 0, cursor[1] + 1 }; break;
+            case '\r': cursor[0] = 0; break;
+            case '\t': cursor[0] = (cursor[0] + 8) & ~7; break;
+            case '\b': if (cursor[0] > 0) --cursor[0]; break;
+            default:
+                buffer()(cursor[0], cursor[1]) = text_char { c, attr };
+                ++cursor[0];
+            }
+            if (cursor[0] >= w) cursor = { 0, cursor[1] + 1 };
+            if (cursor[1] >= h)
+            {
+                scroll(cursor[1] - h + 1);
+                cursor[1] = h - 1;
+            }
+        }
+
+        void text_console::clear()
+        {
+            auto* p = buffer().data();
+            std::fill(p, p + shadow.width() * shadow.height(), text_char { ' ', attr });
+            cursor = { 0, 0 };
+        }
+
+        void text_console::scroll(std::size_t lines)
+        {
+            const std::size_t w = shadow.width(), h = shadow.height();
+            lines = std::min(lines, h);
+            auto* p = buffer().data();
+            std::copy(p + lines * w, p + w * h, p);
+            std::fill(p + (h - lines) * w, p + w * h, text_char { ' ', attr });
+        }
+
+        void text_console::show_cursor(bool visible)
+        {
+            crtc_index.write(0x0a);     // cursor start register, bit 5 disables the cursor
+            auto v = crtc_data.read();
+            crtc_data.write(visible ? v & ~0x20 : v | 0x20);
+        }
+
+        void text_console::update()
+        {
+            auto t0 = chrono::tsc::now();
+            stats.cells = 0;
+            stats.runs = 0;
+
+            const auto* src = reinterpret_cast<const std::uint16_t*>(buffer().data());
+            auto* old = reinterpret_cast<std::uint16_t*>(last.data());
+            auto* dst = reinterpret_cast<std::uint16_t*>(screen->get_ptr());
+            const std::size_t n = last.size();
+            for (std::size_t i = 0; i < n;)
+            {
+                while (i < n and src[i] == old[i]) ++i;
+                if (i == n) break;
+
+                // Extend the run over short stretches of unchanged cells, writing those is cheaper than starting a new run.
+                std::size_t begin = i, end = i;
+                for (std::size_t gap = 0; i < n and gap <= max_gap; ++i)
+                {
+                    if (src[i] != old[i]) { end = i + 1; gap = 0; }
+                    else ++gap;
+                }
+                i = end;
+
+                std::copy(src + begin, src + end, old + begin);
+                auto* d = dst + begin;
+                auto* s = src + begin;
+                std::size_t count = end - begin;
+                asm volatile("rep movsw" : "+D" (d), "+S" (s), "+c" (count) : : "memory");
+                stats.cells += end - begin;
+                ++stats.runs;
+            }
+
+            update_cursor();
+            stats.time = chrono::tsc::now() - t0;
+            ++stats.frames;
+        }
+
+        void text_console::redraw()
+        {
+            // Invalidate every cell, so that update() copies the screen in one run.
+            const auto* src = buffer().data();
+            for (std::size_t i = 0; i < last.size(); ++i) last[i].raw_value = ~src[i].raw_value;
+            hw_cursor = { -1, -1 };
+            update();
+        }
+
+        void text_console::update_cursor()
+        {
+            if (cursor == hw_cursor) return;
+            hw_cursor = cursor;
+            const std::uint16_t pos = bda<std::uint16_t>(0x4e) / 2 + cursor[1] * shadow.width() + cursor[0];
+            crtc_index.write(0x0e);
+            crtc_data.write(pos >> 8);
+            crtc_index.write(0x0f);
+            crtc_data.write(pos & 0xff);
+
+            // Keep the BIOS informed, so that DOS output continues from the same position.
+            const auto page = bda<byte>(0x62);
+            bda<byte>(0x50 + page * 2) = cursor[0];
+            bda<byte>(0x51 + page * 2) = cursor[1];
+        }
+
+        void text_console::redirect_cout()
+        {
+            if (std::cout.rdbuf() == streambuf.get()) return;
+            if (not streambuf) streambuf = std::make_unique<detail::text_console_streambuf>(*this);
+            std::cout.flush();
+            cout = std::cout.rdbuf(streambuf.get());
+        }
+
+        void text_console::restore_cout()
+        {
+            if (cout == nullptr or std::cout.rdbuf() != streambuf.get()) return;
+            std::cout.flush();
+            std::cout.rdbuf(cout);
+            cout = nullptr;
+        }
+
+        namespace detail
+        {
+            void text_console_streambuf::flush_buffer()
+            {
+                con.write({ pbase(), static_cast<std::size_t>(pptr() - pbase()) });
+                setp(buffer.begin(), buffer.end());
+            }
+
+            int text_console_streambuf::sync()
+            {
+                flush_buffer();
+                con.update();
+                return 0;
+            }
+
+            std::streamsize text_console_streambuf::xsputn(const char_type* s, std::streamsize n)
+            {
+                flush_buffer();
+                con.write({ s, static_cast<std::size_t>(n) });
+                return n;
+            }
+
+            text_console_streambuf::int_type text_console_streambuf::overflow(int_type c)
+            {
+                flush_buffer();
+                if (not traits_type::eq_int_type(c, traits_type::eof())) con.put(traits_type::to_char_type(c));
+                return traits_type::not_eof(c);
+            }
+        }
+    }
+}
@@ -0,0 +1,64 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
+
+#include <jw/debug/trace.h>
+#include <jw/chrono/chrono.h>
+
+namespace jw
+{
+    namespace debug
+    {
+        namespace detail
+        {
+            std::array<trace_event, config::enable_trace ? config::trace_buffer_size : 1> trace_buffer;
+        }
+
+        void trace_start() noexcept
+        {
+            detail::trace_enabled = false;
+            detail::trace_position = 0;
+            for (auto&& e : detail::trace_buffer) e.name = nullptr;
+            detail::trace_enabled = true;
+        }
+
+        void trace_stop() noexcept
+        {
+            detail::trace_enabled = false;
+        }
+
+        void trace_write_json(std::ostream& out)
+        {
+            dpmi::throw_if_irq();
+            auto enabled = detail::trace_enabled;
+            detail::trace_enabled = false;
+
+            const std::size_t size = detail::trace_buffer.size();
+            std::size_t end = detail::trace_position;
+            std::size_t begin = end > size ? end - size : 0;
+
+            const auto flags = out.flags();
+            out << "{\"traceEvents\":[";
+            bool first { true };
+            std::uint64_t t0 { 0 };
+            for (auto i = begin; i < end; ++i)
+            {
+                auto& e = detail::trace_buffer[i & (size - 1)];
+                if (e.name == nullptr) continue;
+                if (first) t0 = e.tsc;
+                else out << ',';
+                first = false;
+
+                auto us = chrono::tsc::to_duration(e.tsc - t0).count() / 1e3;
+                out << "\n{\"name\":\"" << e.name << "\",\"ph\":\"" << e.type << '"';
+                if (e.type == 'i') out << ",\"s\":\"t\"";
+                out << ",\"ts\":" << std::fixed << us;
+                out << ",\"pid\":0,\"tid\":" << std::dec << e.thread;
+                out << ",\"args\":{\"nesting\":" << static_cast<unsigned>(e.nesting) << "}}";
+            }
+            out << "\n]}\n";
+            out.flags(flags);
+
+            detail::trace_enabled = enabled;
+        }
+    }
+}
@@ -318,6 +318,7 @@ namespace jw
             mode = m;
             mode_info = &modes[m.mode];
             dac_bits = 6;
+            scanline_valid = false;
         }
 
         void vbe3::set_mode(vbe_mode m, const crtc_info* crtc)
@@ -339,6 +340,7 @@ namespace jw
             mode = m;
             mode_info = &modes[m.mode];
             dac_bits = 6;
+            scanline_valid = false;
         } 
 
         std::tuple<std::size_t, std::size_t, std::size_t> vbe::set_scanline_length(std::size_t width, bool width_in_pixels)
@@ -352,7 +354,8 @@ namespace jw
             std::uint16_t pixels_per_scanline = reg.cx;
             std::uint16_t bytes_per_scanline = reg.bx;
             std::uint16_t max_scanlines = reg.dx;
-            return { pixels_per_scanline, bytes_per_scanline, max_scanlines };
+            scanline_valid = true;
+            return scanline = { pixels_per_scanline, bytes_per_scanline, max_scanlines };
         }
 
         std::tuple<std::size_t, std::size_t, std::size_t> vbe3::set_scanline_length(std::size_t width, bool width_in_pixels)
@@ -371,11 +374,13 @@ namespace jw
                 , "c" (width)
                 : "edi", "esi", "cc");
             check_error(ax, __PRETTY_FUNCTION__);
-            return { pixels_per_scanline, bytes_per_scanline, max_scanlines };
+            scanline_valid = true;
+            return scanline = { pixels_per_scanline, bytes_per_scanline, max_scanlines };
         }
 
         std::tuple<std::size_t, std::size_t, std::size_t> vbe::get_scanline_length()
         {
+            if (scanline_valid) return scanline;
             dpmi::realmode_registers reg { };
             reg.ax = 0x4f06;
             reg.bl = 1;
@@ -384,7 +389,26 @@ namespace jw
             std::uint16_t pixels_per_scanline = reg.cx;
             std::uint16_t bytes_per_scanline = reg.bx;
             std::uint16_t max_scanlines = reg.dx;
-            return { pixels_per_scanline, bytes_per_scanline, max_scanlines };
+            scanline_valid = true;
+            return scanline = { pixels_per_scanline, bytes_per_scanline, max_scanlines };
+        }
+
+        std::tuple<std::size_t, std::size_t, std::size_t> vbe3::get_scanline_length()
+        {
+            if (scanline_valid or !vbe3_pm) return vbe2::get_scanline_length();
+
+            std::uint16_t ax, pixels_per_scanline, bytes_per_scanline, max_scanlines;
+            asm("call fword ptr [vbe3_call];"
+                : "=a" (ax)
+                , "=b" (bytes_per_scanline)
+                , "=c" (pixels_per_scanline)
+                , "=d" (max_scanlines)
+                : "a" (0x4f06)
+                , "b" (1)
+                : "edi", "esi", "cc");
+            check_error(ax, __PRETTY_FUNCTION__);
+            scanline_valid = true;
+            return scanline = { pixels_per_scanline, bytes_per_scanline, max_scanlines };
         }
 
         std::tuple<std::size_t, std::size_t, std::size_t> vbe::get_max_scanline_length()
@@ -483,6 +507,23 @@ namespace jw
             return { first_pixel, first_scanline };
         }
 
+        vector2i vbe3::get_display_start()
+        {
+            if (!vbe3_pm) return vbe2::get_display_start();
+
+            std::uint16_t ax, first_pixel, first_scanline;
+            asm volatile(
+                "call fword ptr [vbe3_call];"
+                : "=a" (ax)
+                , "=c" (first_pixel)
+                , "=d" (first_scanline)
+                : "a" (0x4f07)
+                , "b" (1)
+                : "edi", "esi", "cc");
+            check_error(ax, __PRETTY_FUNCTION__);
+            return { first_pixel, first_scanline };
+        }
+
         void vbe::schedule_display_start(vector2i pos)
         {
             return set_display_start(pos, false);
@@ -590,9 +631,27 @@ namespace jw
             return reg.bh;
         }
 
+        std::uint8_t vbe3::get_palette_format()
+        {
+            if (!vbe3_pm) return vbe2::get_palette_format();
+
+            std::uint16_t ax;
+            split_uint16_t bx;
+            asm volatile(
+                "call fword ptr [vbe3_call];"
+                : "=a" (ax)
+                , "=b" (bx)
+                : "a" (0x4f08)
+                , "b" (1)
+                : "ecx", "edx", "edi", "esi", "cc");
+            check_error(ax, __PRETTY_FUNCTION__);
+            dac_bits = bx.hi;
+            return bx.hi;
+        }
+
         void vbe2::set_palette(const px32n* begin, const px32n* end, std::size_t first, bool wait_for_vsync)
         {
-            //return vga::set_palette(begin, end, first, wait_for_vsync);
+            if (not vbe2_pm and vga_compatible() and not wait_for_vsync) return vga::set_palette(begin, end, first, wait_for_vsync);
             auto size = std::min(static_cast<std::size_t>(end - begin), std::size_t { 256 });
             if (vbe2_pm)
             {
@@ -681,6 +740,7 @@ namespace jw
 
         std::vector<px32n> vbe2::get_palette()
         {
+            if (vga_compatible()) return vga::get_palette();
             dpmi::dos_memory<px32n> dos_data { 256 };
 
             dpmi::realmode_registers reg { };
@@ -703,6 +763,51 @@ namespace jw
             return result;
         }
 
+        void vbe::set_window(std::size_t position, bool window_b)
+        {
+            dpmi::realmode_registers reg { };
+            reg.ax = 0x4f05;
+            reg.bh = 0;
+            reg.bl = window_b ? 1 : 0;
+            reg.dx = position;
+            reg.call_int(0x10);
+            check_error(reg.ax, __PRETTY_FUNCTION__);
+        }
+
+        void vbe2::set_window(std::size_t position, bool window_b)
+        {
+            if (!vbe2_pm) return vbe::set_window(position, window_b);
+
+            // The protected-mode window function does not return a status.
+            dpmi::selector mmio = vbe2_mmio ? vbe2_mmio->get_selector() : dpmi::get_ds();
+            asm volatile(
+                "push es;"
+                "mov es, %w1;"
+                "call %0;"
+                "pop es;"
+                :: "rm" (vbe2_call_set_window)
+                , "rm" (mmio)
+                , "a" (0x4f05)
+                , "b" (window_b ? 1 : 0)
+                , "d" (position)
+                : "ecx", "edi", "esi", "esp", "cc");
+        }
+
+        void vbe3::set_window(std::size_t position, bool window_b)
+        {
+            if (!vbe3_pm) return vbe2::set_window(position, window_b);
+
+            std::uint16_t ax;
+            asm volatile(
+                "call fword ptr [vbe3_call];"
+                : "=a" (ax)
+                : "a" (0x4f05)
+                , "b" (window_b ? 1 : 0)
+                , "d" (position)
+                : "ecx", "edi", "esi", "cc");
+            check_error(ax, __PRETTY_FUNCTION__);
+        }
+
         std::uint32_t vbe3::get_closest_pixel_clock(std::uint32_t desired_clock, std::uint16_t mode_num)
         {
             if (vbe3_pm)
@@ -2,6 +2,7 @@
 /* Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details */
 /* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
 
+#include <array>
 #include <jw/video/vga.h>
 #include <jw/dpmi/realmode.h>
 
@@ -20,51 +21,45 @@ namespace jw
 
         void vga::set_palette(const px32n* begin, const px32n* end, std::size_t first, bool)
         {
-            dac_write_index.write(first);
+            // Convert to the DAC format first, so that it can be uploaded in one go with rep outsb.
+            std::array<byte, 256 * 3> data;
+            auto size = std::min(static_cast<std::size_t>(end - begin), 256 - std::min(first, std::size_t { 256 }));
+            auto* ptr = data.data();
             if (dac_bits == 8)
             {
-                for (auto i = begin; i < end; ++i)
+                for (auto i = begin; i < begin + size; ++i)
                 {
-                    dac_data.write(i->r);
-                    dac_data.write(i->g);
-                    dac_data.write(i->b);
+                    *ptr++ = i->r;
+                    *ptr++ = i->g;
+                    *ptr++ = i->b;
                 }
             }
             else
             {
-                for (auto i = begin; i < end; ++i)
+                for (auto i = begin; i < begin + size; ++i)
                 {
                     auto p = static_cast<const pxvga>(*i);
-                    dac_data.write(p.r);
-                    dac_data.write(p.g);
-                    dac_data.write(p.b);
+                    *ptr++ = p.r;
+                    *ptr++ = p.g;
+                    *ptr++ = p.b;
                 }
             }
+            dac_write_index.write(first);
+            dac_data.write(data.data(), size * 3);
         }
 
         std::vector<px32n> vga::get_palette()
         {
-            std::vector<px32n> result { };
+            std::array<byte, 256 * 3> data;
             dac_read_index.write(0);
-            if (dac_bits == 8)
-            {
-                for (auto i = 0; i < 256; ++i)
-                {
-                    auto r = dac_data.read();
-                    auto g = dac_data.read();
-                    auto b = dac_data.read();
-                    result.emplace_back(r, g, b);
-                }
-            }
-            else
+            dac_data.read(data.data(), data.size());
+
+            std::vector<px32n> result { };
+            result.reserve(256);
+            for (auto ptr = data.cbegin(); ptr != data.cend(); ptr += 3)
             {
-                for (auto i = 0; i < 256; ++i)
-                {
-                    auto r = dac_data.read();
-                    auto g = dac_data.read();
-                    auto b = dac_data.read();
-                    result.emplace_back(pxvga { r, g, b });
-                }
+                if (dac_bits == 8) result.emplace_back(ptr[0], ptr[1], ptr[2]);
+                else result.emplace_back(pxvga { ptr[0], ptr[1], ptr[2] });
             }
             return result;
         }
@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+# * * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * *
+# Copyright (C) 2018 J.W. Jagersma, see COPYING.txt for details
+
+# Converts a stream recorded by jw::debug::profiler into a flat profile and a call graph.
+# Symbols are read from the symbol table of the ELF executable, or from the output of nm for other
+# object formats (eg. COFF):
+#     jwprof.py program.elf profile.bin
+#     i586-pc-msdosdjgpp-nm -C program.exe > program.sym; jwprof.py --nm program.sym profile.bin
+# Return addresses are looked up at address - 1, so calls at the end of a function are attributed correctly.
+
+import argparse
+import bisect
+import collections
+import struct
+import subprocess
+import sys
+
+
+def read_elf_symbols(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data[:4] != b'\x7fELF':
+        raise ValueError(f'{path}: not an ELF file, use --nm')
+    if data[4] != 1 or data[5] != 1:
+        raise ValueError(f'{path}: expected a 32-bit little-endian ELF file')
+    shoff, = struct.unpack_from('<I', data, 0x20)
+    shentsize, shnum = struct.unpack_from('<HH', data, 0x2e)
+    sections = [struct.unpack_from('<IIIIIIIIII', data, shoff + i * shentsize) for i in range(shnum)]
+
+    symbols = []
+    for sh in sections:
+        if sh[1] not in (2, 11):        # SHT_SYMTAB, SHT_DYNSYM
+            continue
+        strtab = sections[sh[6]]
+        for off in range(sh[4], sh[4] + sh[5], 16):
+            name, value, size, info, _, shndx = struct.unpack_from('<IIIBBH', data, off)
+            if info & 0xf != 2 or shndx == 0:       # STT_FUNC, defined
+                continue
+            start = strtab[4] + name
+            symbols.append((value, size, data[start:data.index(b'\0', start)].decode(errors='replace')))
+    return demangle(symbols)
+
+
+def read_nm_symbols(path):
+    symbols = []
+    with open(path) as f:
+        for line in f:
+            parts = line.split(maxsplit=2)
+            if len(parts) == 3 and parts[1] in 'tTwW':
+                symbols.append((int(parts[0], 16), 0, parts[2].strip()))
+    return demangle(symbols)
+
+
+def demangle(symbols):
+    try:
+        names = subprocess.run(['c++filt'], input='\n'.join(s[2] for s in symbols), capture_output=True, text=True, check=True).stdout.split('\n')
+        return [(a, n, d) for (a, n, _), d in zip(symbols, names)]
+    except (OSError, subprocess.CalledProcessError):
+        return symbols
+
+
+class symbolizer:
+    def __init__(self, symbols):
+        symbols = sorted(set(symbols))
+        self.starts = [s[0] for s in symbols]
+        self.symbols = symbols
+        self.cache = {}
+
+    def __call__(self, addr):
+        if addr == 0:
+            return '<outside program>'
+        if addr not in self.cache:
+            i = bisect.bisect_right(self.starts, addr) - 1
+            name = f'0x{addr:08x}'
+            if i >= 0:
+                start, size, sym = self.symbols[i]
+                if size == 0 or addr < start + size:
+                    name = sym
+            self.cache[addr] = name
+        return self.cache[addr]
+
+
+def read_samples(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data[:6] != b'JWPROF':
+        raise ValueError(f'{path}: not a profiler stream')
+    if data[6] != 1:
+        raise ValueError(f'{path}: unsupported version {data[6]}')
+    source = ('pit', 'rtc')[data[7]] if data[7] < 2 else str(data[7])
+    samples, lost, pos = [], 0, 8
+    while pos < len(data):
+        n = data[pos]
+        pos += 1
+        if n == 0xff:
+            if pos + 4 > len(data):
+                break
+            lost += struct.unpack_from('<I', data, pos)[0]
+            pos += 4
+            continue
+        if pos + 4 * (n + 1) > len(data):
+            break                               # truncated stream
+        samples.append(struct.unpack_from(f'<{n + 1}I', data, pos))
+        pos += 4 * (n + 1)
+    return source, samples, lost
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert a libjwdpmi profiler stream into a flat profile and call graph.')
+    parser.add_argument('executable', nargs='?', help='ELF executable with symbols')
+    parser.add_argument('stream', help='recorded profiler stream')
+    parser.add_argument('--nm', help='read symbols from nm output instead')
+    parser.add_argument('--limit', type=int, default=30, help='number of entries to show (default 30)')
+    args = parser.parse_args()
+    if args.nm is None and args.executable is None:
+        parser.error('an executable or --nm symbol file is required')
+
+    sym = symbolizer(read_nm_symbols(args.nm) if args.nm else read_elf_symbols(args.executable))
+    source, samples, lost = read_samples(args.stream)
+    total = len(samples)
+    if total == 0:
+        print('No samples.')
+        return
+
+    self_count = collections.Counter()
+    total_count = collections.Counter()
+    callers = collections.defaultdict(collections.Counter)
+    for s in samples:
+        frames = [sym(s[0])] + [sym(a - 1) for a in s[1:]]
+        self_count[frames[0]] += 1
+        for f in set(frames):
+            total_count[f] += 1
+        for callee, caller in zip(frames, frames[1:]):
+            callers[callee][caller] += 1
+
+    print(f'{total} samples from {source}, {lost} lost.\n')
+    print('Flat profile:')
+    print(f'{"self":>8} {"%":>6} {"total":>8} {"%":>6}  function')
+    for f, n in self_count.most_common(args.limit):
+        print(f'{n:8} {100 * n / total:6.2f} {total_count[f]:8} {100 * total_count[f] / total:6.2f}  {f}')
+
+    if not any(len(s) > 1 for s in samples):
+        return
+    print('\nCall graph (inclusive samples, with callers):')
+    for f, n in total_count.most_common(args.limit):
+        print(f'{n:8} {100 * n / total:6.2f}  {f}')
+        for c, m in callers[f].most_common(5):
+            print(f'{"":8} {m:6}    <- {c}')
+
+
+if __name__ == '__main__':
+    try:
+        main()
+    except (OSError, ValueError) as e:
+        sys.exit(f'jwprof: {e}')